@@ -14,10 +14,20 @@ return {
         right_thruster = place(BLOCK_THRUSTER, -2, 1)
         radar = place(BLOCK_RADAR, 1, 0)
         gun = place(BLOCK_GUN, 2, 0)
+
+        -- optional typed handles, calls through them skip looking up the block by id:
+        -- gun_handle gives a Gun with id, angle, rotate, aim, cooled_down and shoot, radar_handle
+        -- a Radar with id, angle, rotate, aim and ping, thruster_handle a Thruster with id,
+        -- throttle and set. they return nil for blocks that are not part of this ship
+        -- gun_turret = gun_handle(gun)
+        -- gun_turret:rotate(50)
+        -- if gun_turret:cooled_down() then gun_turret:shoot() end
     end,
 
     update = function()
         local elapsed_time = time();
+        -- seconds since this script last ran, ships with nothing nearby run less often
+        local dt = delta_time();
         local ships = ships_count();
 
         local ship_angle = ship_angle()
@@ -28,6 +38,15 @@ return {
         -- print("Ship pos:", x, y)
         -- print("Ship vel:", dx, dy)
 
+        -- every entry is a table with id, x, y and distance
+        local ships_nearby = nearby_ships(1000.0)
+        local projectiles_nearby = nearby_projectiles(300.0)
+        local closest = nearest_ships(1)
+        -- if (closest[1]) then print("Closest ship:", closest[1].id, closest[1].distance) end
+
+        -- blocks hit by projectiles take damage and get destroyed, losing the hub destroys the
+        -- whole ship. calls with the id of a destroyed block log an error and do nothing
+        -- actuator settings stay until they are changed, the radar keeps turning at this rate
         local radar_angle = radar_angle(radar)
         -- print("Radar angle:", radar_angle)
         radar_rotate(radar, -50.0)
@@ -37,6 +56,8 @@ return {
         local gun_angle = gun_angle(gun)
         -- print("Gun angle:", gun_angle)
         gun_rotate(gun, -100.0)
+        -- or turn towards an angle relative to the ship, until the next rotate call
+        -- gun_aim(gun, math.pi / 2)
         if (distance > 0) then
             if (gun_cooled_down(gun)) then
                 gun_shoot(gun)
@@ -46,4 +67,21 @@ return {
         thruster_set(left_thruster, 0)
         thruster_set(right_thruster, 0)
     end,
+
+    -- optional, runs as a coroutine next to update. coroutine.yield() continues on the next tick,
+    -- actuators keep their settings in the meantime. once it returns it starts over
+    run = function()
+        -- seconds run took on the last tick
+        local last_run = run_time()
+
+        for i = 1, 1000 do
+            -- yields when budget_left() is 0, the plan continues next tick
+            yield_if_over_budget()
+        end
+
+        -- turn for half a second, then stop
+        thruster_set(left_thruster, 1)
+        for i = 1, 30 do coroutine.yield() end
+        thruster_set(left_thruster, 0)
+    end,
 }
@@ -0,0 +1,10 @@
+-- gun heavy ships in the middle, fast snakes all around them
+return {
+    name = "death_stars_vs_noodles",
+    ticks = 5000,
+    ships = {
+        { script = "./assets/scripting/death_star.lua", x = 0, y = 0, count = 10, dx = 600 },
+        { script = "./assets/scripting/danger_noodle.lua", x = 0, y = -800, count = 25, dx = 240 },
+        { script = "./assets/scripting/danger_noodle.lua", x = 0, y = 800, count = 25, dx = 240 },
+    },
+}
@@ -0,0 +1,12 @@
+-- about 10k bodies with a checkpoint saved every tick, the checkpoint should stay below 1 ms
+return {
+    name = "rollback_death_stars",
+    ticks = 1000,
+    rollback = 2,
+    ships = {
+        { script = "./assets/scripting/death_star.lua", x = 0, y = -1800, count = 31, dx = 600 },
+        { script = "./assets/scripting/death_star.lua", x = 0, y = -600, count = 31, dx = 600 },
+        { script = "./assets/scripting/death_star.lua", x = 0, y = 600, count = 31, dx = 600 },
+        { script = "./assets/scripting/death_star.lua", x = 0, y = 1800, count = 31, dx = 600 },
+    },
+}
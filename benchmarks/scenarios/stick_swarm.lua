@@ -0,0 +1,8 @@
+-- many small ships, dominated by per ship script overhead
+return {
+    name = "stick_swarm",
+    ticks = 3000,
+    ships = {
+        { script = "./assets/scripting/stick_ship.lua", x = 0, y = 0, count = 200, dx = 160 },
+    },
+}
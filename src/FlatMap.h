@@ -0,0 +1,141 @@
+#pragma once
+
+#include "assert.h"
+#include "defines.h"
+
+#include <vector>
+
+// open addressing hash map for small trivially copyable keys and values. all slots live in one
+// vector that only grows, once it fits the most entries ever held at a time inserting and
+// erasing never touch the heap. erase shifts the following entries of a probe run back instead
+// of leaving tombstones. inserting and erasing invalidate pointers to values.
+template <class Key, class Value> class FlatMap {
+  public:
+    explicit FlatMap(usize capacity = 64) { m_slots.resize(round_up(capacity * 2)); }
+
+    usize size() const { return m_size; }
+
+    void clear() {
+        for (auto &slot : m_slots) {
+            slot.used = false;
+        }
+        m_size = 0;
+    }
+
+    Value *find(Key key) {
+        const auto mask = m_slots.size() - 1;
+        for (auto i = hash(key) & mask;; i = (i + 1) & mask) {
+            auto &slot = m_slots[i];
+            if (!slot.used)
+                return nullptr;
+            if (slot.key == key)
+                return &slot.value;
+        }
+    }
+
+    const Value *find(Key key) const { return const_cast<FlatMap *>(this)->find(key); }
+
+    // inserts or overwrites the value of key
+    Value &insert(Key key, const Value &value) {
+        if ((m_size + 1) * 2 > m_slots.size()) {
+            grow();
+        }
+
+        const auto mask = m_slots.size() - 1;
+        for (auto i = hash(key) & mask;; i = (i + 1) & mask) {
+            auto &slot = m_slots[i];
+            if (slot.used && slot.key != key)
+                continue;
+
+            if (!slot.used) {
+                slot.used = true;
+                slot.key = key;
+                ++m_size;
+            }
+
+            slot.value = value;
+            return slot.value;
+        }
+    }
+
+    bool erase(Key key) {
+        const auto mask = m_slots.size() - 1;
+        for (auto i = hash(key) & mask;; i = (i + 1) & mask) {
+            if (!m_slots[i].used)
+                return false;
+
+            if (m_slots[i].key == key) {
+                erase_at(i);
+                return true;
+            }
+        }
+    }
+
+    // calls fn(key, value) for every entry and erases the ones it returns true for. entries can
+    // be visited twice when an erase shifts them, fn must give the same answer again
+    template <class Fn> void erase_if(Fn fn) {
+        for (usize i = 0; i < m_slots.size();) {
+            auto &slot = m_slots[i];
+            if (slot.used && fn(slot.key, slot.value)) {
+                // the slot now holds an entry shifted back from further along, check it again
+                erase_at(i);
+                continue;
+            }
+
+            ++i;
+        }
+    }
+
+  private:
+    struct Slot {
+        Key key{};
+        Value value{};
+        bool used = false;
+    };
+
+    static usize round_up(usize capacity) {
+        usize size = 16;
+        while (size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    // splitmix64 finalizer, ids and packed cell coordinates hash badly on their own
+    static usize hash(Key key) {
+        u64 value = static_cast<u64>(key);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return static_cast<usize>(value ^ (value >> 31));
+    }
+
+    void erase_at(usize hole) {
+        const auto mask = m_slots.size() - 1;
+        for (auto i = (hole + 1) & mask; m_slots[i].used; i = (i + 1) & mask) {
+            // an entry can fill the hole unless its home slot lies after the hole
+            const auto home = hash(m_slots[i].key) & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                m_slots[hole] = m_slots[i];
+                hole = i;
+            }
+        }
+
+        m_slots[hole].used = false;
+        --m_size;
+    }
+
+    void grow() {
+        std::vector<Slot> old(m_slots.size() * 2);
+        old.swap(m_slots);
+        m_size = 0;
+
+        for (const auto &slot : old) {
+            if (slot.used) {
+                insert(slot.key, slot.value);
+            }
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    usize m_size = 0;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "assert.h"
+#include "defines.h"
+
+#include <memory>
+#include <vector>
+
+// the struct definitions are needed to size the pool slots, chipmunk objects are only
+// initialized in place here and otherwise used through the public api
+#include <chipmunk/chipmunk.h>
+#include <chipmunk/chipmunk_structs.h>
+
+// fixed size slots allocated in chunks that never move, so handed out pointers stay valid.
+// released slots are reused before a new chunk is allocated, once the pool has grown to the
+// largest number of live objects acquiring and releasing never touches the heap.
+template <class T, usize CHUNK_SIZE = 256> class SlabPool {
+  public:
+    SlabPool() = default;
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    // zeroed like the calloc chipmunk uses in its own *New functions
+    T *acquire() {
+        if (m_free.empty()) {
+            grow();
+        }
+
+        T *slot = m_free.back();
+        m_free.pop_back();
+        *slot = T{};
+        ++m_live;
+        return slot;
+    }
+
+    void release(T *slot) {
+        debug_assert(m_live > 0, "released more slots than were acquired");
+        --m_live;
+        // reserved up to the capacity in grow, never allocates
+        m_free.push_back(slot);
+    }
+
+    usize live() const { return m_live; }
+    usize capacity() const { return m_chunks.size() * CHUNK_SIZE; }
+
+  private:
+    void grow() {
+        m_chunks.push_back(std::make_unique<T[]>(CHUNK_SIZE));
+        m_free.reserve(capacity());
+
+        // handed out front to back
+        auto chunk = m_chunks.back().get();
+        for (usize i = CHUNK_SIZE; i > 0; --i) {
+            m_free.push_back(chunk + i - 1);
+        }
+    }
+
+    std::vector<std::unique_ptr<T[]>> m_chunks;
+    std::vector<T *> m_free;
+    usize m_live = 0;
+};
+
+struct PhysicsPoolStats {
+    usize bodies = 0;
+    usize shapes = 0;
+    usize constraints = 0;
+    // bytes of all slots, used or not
+    usize bytes = 0;
+};
+
+// owns the memory of every chipmunk body, shape and constraint of a space. objects are created
+// with the cp*Init functions into pool slots and must be destroyed through destroy_body, never
+// with the cp*Free functions. the pool has to outlive the space.
+class PhysicsPool {
+  public:
+    cpBody *body(cpFloat mass, cpFloat moment) {
+        return cpBodyInit(m_bodies.acquire(), mass, moment);
+    }
+
+    // four vertices fit into the inline storage of cpPolyShape, boxes never allocate
+    cpShape *box(cpBody *body, cpFloat width, cpFloat height) {
+        return cpBoxShapeInit(m_boxes.acquire(), body, width, height, 0);
+    }
+
+    cpConstraint *damped_spring(cpBody *a, cpBody *b, cpVect anchor_a, cpVect anchor_b,
+                                cpFloat rest_length, cpFloat stiffness, cpFloat damping) {
+        return cpDampedSpringInit(m_springs.acquire(), a, b, anchor_a, anchor_b, rest_length,
+                                  stiffness, damping);
+    }
+
+    cpConstraint *damped_rotary_spring(cpBody *a, cpBody *b, cpFloat rest_angle,
+                                       cpFloat stiffness, cpFloat damping) {
+        return cpDampedRotarySpringInit(m_rotary_springs.acquire(), a, b, rest_angle, stiffness,
+                                        damping);
+    }
+
+    // removes a body with its shapes and constraints from the space and returns all of them
+    // to the pool. constraints are shared with another body, which keeps its other ones
+    void destroy_body(cpSpace *space, cpBody *body) {
+        m_destroying = space;
+
+        cpBodyEachShape(
+            body,
+            [](cpBody *, cpShape *shape, void *data) {
+                auto pool = static_cast<PhysicsPool *>(data);
+                cpSpaceRemoveShape(pool->m_destroying, shape);
+                cpShapeDestroy(shape);
+                // only boxes are created
+                pool->m_boxes.release(reinterpret_cast<cpPolyShape *>(shape));
+            },
+            this);
+
+        cpBodyEachConstraint(
+            body,
+            [](cpBody *, cpConstraint *constraint, void *data) {
+                auto pool = static_cast<PhysicsPool *>(data);
+                cpSpaceRemoveConstraint(pool->m_destroying, constraint);
+                cpConstraintDestroy(constraint);
+
+                if (cpConstraintIsDampedSpring(constraint)) {
+                    pool->m_springs.release(reinterpret_cast<cpDampedSpring *>(constraint));
+                } else {
+                    always_assert(cpConstraintIsDampedRotarySpring(constraint),
+                                  "constraint was not created by the physics pool");
+                    pool->m_rotary_springs.release(
+                        reinterpret_cast<cpDampedRotarySpring *>(constraint));
+                }
+            },
+            this);
+
+        cpSpaceRemoveBody(space, body);
+        cpBodyDestroy(body);
+        m_bodies.release(body);
+
+        m_destroying = nullptr;
+    }
+
+    PhysicsPoolStats stats() const {
+        return PhysicsPoolStats{
+            .bodies = m_bodies.live(),
+            .shapes = m_boxes.live(),
+            .constraints = m_springs.live() + m_rotary_springs.live(),
+            .bytes = m_bodies.capacity() * sizeof(cpBody) +
+                     m_boxes.capacity() * sizeof(cpPolyShape) +
+                     m_springs.capacity() * sizeof(cpDampedSpring) +
+                     m_rotary_springs.capacity() * sizeof(cpDampedRotarySpring),
+        };
+    }
+
+  private:
+    SlabPool<cpBody> m_bodies;
+    SlabPool<cpPolyShape> m_boxes;
+    SlabPool<cpDampedSpring> m_springs;
+    SlabPool<cpDampedRotarySpring> m_rotary_springs;
+
+    // space of the running destroy_body, the iterator callbacks only get one data pointer
+    cpSpace *m_destroying = nullptr;
+};
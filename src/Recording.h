@@ -0,0 +1,332 @@
+#pragma once
+
+#include "defines.h"
+#include "ecs.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+// binary log of everything that influences the simulation, recorded per tick. replaying it
+// re-drives the simulation without running any lua, which makes runs deterministic and
+// repeatable for benchmarks and bisecting.
+//
+// layout: magic, version, then a stream of entries each starting with a RecordType byte.
+// integers are LEB128 varints, signed ones zigzag encoded, floats are stored raw.
+
+const char RECORDING_MAGIC[4] = {'N', 'A', 'V', 'R'};
+const u32 RECORDING_VERSION = 2;
+
+enum struct RecordType : u8 {
+    // starts the entries of a tick, followed by the tick delta to the previous tick marker
+    Tick = 0,
+    // camera keys as a bitmask, only written when they changed
+    Input = 1,
+    SpawnShip = 2,
+    Thrust = 3,
+    RadarRotate = 4,
+    GunRotate = 5,
+    GunShoot = 6,
+    RadarAim = 7,
+    GunAim = 8,
+    End = 0xFF,
+};
+
+enum InputBits : u8 {
+    INPUT_UP = 1 << 0,
+    INPUT_DOWN = 1 << 1,
+    INPUT_LEFT = 1 << 2,
+    INPUT_RIGHT = 1 << 3,
+};
+
+struct BlockPlacement {
+    u8 type;
+    i32 dx, dy;
+};
+
+struct ShipSpawnRecord {
+    std::string name;
+    f32 x, y;
+    std::vector<BlockPlacement> blocks;
+};
+
+struct ShipCommand {
+    RecordType type;
+    EntityId ship_id;
+    EntityId block_id;
+    // throttle, turn percentage or aim rotation, unused for shots
+    f32 value;
+};
+
+struct TickRecord {
+    std::optional<u8> input;
+    std::vector<ShipSpawnRecord> spawns;
+    std::vector<ShipCommand> commands;
+
+    void clear() {
+        input.reset();
+        spawns.clear();
+        commands.clear();
+    }
+};
+
+class CommandRecorder {
+  public:
+    bool open(const std::string &path) {
+        m_out.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_out) {
+            return false;
+        }
+
+        m_out.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+        write_u32(RECORDING_VERSION);
+        return true;
+    }
+
+    ~CommandRecorder() {
+        if (m_out.is_open()) {
+            write_type(RecordType::End);
+        }
+    }
+
+    bool is_open() const { return m_out.is_open(); }
+
+    // entries are attributed to this tick until the next call
+    void begin_tick(u64 tick) { m_tick = tick; }
+
+    void input(u8 mask) {
+        if (m_last_input == mask)
+            return;
+
+        m_last_input = mask;
+        write_header(RecordType::Input);
+        m_out.put(static_cast<char>(mask));
+    }
+
+    void spawn_ship(const ShipSpawnRecord &spawn) {
+        write_header(RecordType::SpawnShip);
+        write_varint(spawn.name.size());
+        m_out.write(spawn.name.data(), static_cast<std::streamsize>(spawn.name.size()));
+        write_f32(spawn.x);
+        write_f32(spawn.y);
+
+        write_varint(spawn.blocks.size());
+        for (const auto &block : spawn.blocks) {
+            m_out.put(static_cast<char>(block.type));
+            write_signed(block.dx);
+            write_signed(block.dy);
+        }
+    }
+
+    void command(const ShipCommand &command) {
+        write_header(command.type);
+        write_varint(command.ship_id);
+        write_varint(command.block_id);
+
+        if (command.type != RecordType::GunShoot) {
+            write_f32(command.value);
+        }
+    }
+
+  private:
+    void write_header(RecordType type) {
+        if (!m_written_tick || *m_written_tick != m_tick) {
+            write_type(RecordType::Tick);
+            write_varint(m_tick - m_written_tick.value_or(0));
+            m_written_tick = m_tick;
+        }
+
+        write_type(type);
+    }
+
+    void write_type(RecordType type) { m_out.put(static_cast<char>(type)); }
+
+    void write_varint(u64 value) {
+        do {
+            u8 byte = value & 0x7F;
+            value >>= 7;
+            m_out.put(static_cast<char>(value ? byte | 0x80 : byte));
+        } while (value);
+    }
+
+    void write_signed(i64 value) {
+        write_varint((static_cast<u64>(value) << 1) ^ static_cast<u64>(value >> 63));
+    }
+
+    void write_u32(u32 value) { m_out.write(reinterpret_cast<const char *>(&value), 4); }
+    void write_f32(f32 value) { m_out.write(reinterpret_cast<const char *>(&value), 4); }
+
+    std::ofstream m_out;
+    u64 m_tick = 0;
+    std::optional<u64> m_written_tick;
+    std::optional<u8> m_last_input;
+};
+
+class CommandReplay {
+  public:
+    bool open(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        m_data.assign(std::istreambuf_iterator<char>(file), {});
+        m_cursor = 0;
+
+        if (m_data.size() < 8 || std::memcmp(m_data.data(), RECORDING_MAGIC, 4) != 0) {
+            std::cerr << "Not a recording: " << path << std::endl;
+            return false;
+        }
+
+        m_cursor = 4;
+        if (read_u32() != RECORDING_VERSION) {
+            std::cerr << "Unsupported recording version: " << path << std::endl;
+            return false;
+        }
+
+        read_next_tick();
+        return true;
+    }
+
+    bool finished() const { return !m_next_tick.has_value(); }
+
+    // fills out with everything recorded for tick, ticks have to be read in increasing order
+    void read_tick(u64 tick, TickRecord &out) {
+        out.clear();
+
+        if (!m_next_tick || *m_next_tick != tick)
+            return;
+
+        while (m_cursor < m_data.size()) {
+            auto type = static_cast<RecordType>(m_data[m_cursor]);
+            if (type == RecordType::Tick || type == RecordType::End)
+                break;
+
+            ++m_cursor;
+
+            switch (type) {
+            case RecordType::Input:
+                out.input = read_u8();
+                break;
+            case RecordType::SpawnShip: {
+                ShipSpawnRecord spawn;
+                auto name_length = read_varint();
+                if (name_length > m_data.size() - m_cursor) {
+                    corrupt("ship name is truncated");
+                    break;
+                }
+
+                spawn.name.assign(reinterpret_cast<const char *>(m_data.data() + m_cursor),
+                                  name_length);
+                m_cursor += name_length;
+                spawn.x = read_f32();
+                spawn.y = read_f32();
+
+                // every block takes at least three bytes
+                auto block_count = read_varint();
+                if (m_cursor > m_data.size() || block_count > (m_data.size() - m_cursor) / 3) {
+                    corrupt("ship blocks are truncated");
+                    break;
+                }
+
+                spawn.blocks.reserve(block_count);
+                for (u64 i = 0; i < block_count; ++i) {
+                    auto block_type = read_u8();
+                    auto dx = static_cast<i32>(read_signed());
+                    auto dy = static_cast<i32>(read_signed());
+                    spawn.blocks.push_back(BlockPlacement{.type = block_type, .dx = dx, .dy = dy});
+                }
+
+                out.spawns.push_back(std::move(spawn));
+                break;
+            }
+            case RecordType::Thrust:
+            case RecordType::RadarRotate:
+            case RecordType::GunRotate:
+            case RecordType::GunShoot:
+            case RecordType::RadarAim:
+            case RecordType::GunAim: {
+                ShipCommand command{.type = type, .ship_id = 0, .block_id = 0, .value = 0.0f};
+                command.ship_id = read_varint();
+                command.block_id = read_varint();
+                if (type != RecordType::GunShoot) {
+                    command.value = read_f32();
+                }
+
+                out.commands.push_back(command);
+                break;
+            }
+            default:
+                std::cerr << "Corrupt recording, unknown entry " << static_cast<u32>(type)
+                          << std::endl;
+                m_cursor = m_data.size();
+                break;
+            }
+        }
+
+        read_next_tick();
+    }
+
+  private:
+    // drops the rest of the recording
+    void corrupt(const char *reason) {
+        std::cerr << "Corrupt recording, " << reason << std::endl;
+        m_cursor = m_data.size();
+    }
+
+    void read_next_tick() {
+        if (m_cursor >= m_data.size() ||
+            static_cast<RecordType>(m_data[m_cursor]) != RecordType::Tick) {
+            m_next_tick.reset();
+            return;
+        }
+
+        ++m_cursor;
+        m_next_tick = m_next_tick.value_or(0) + read_varint();
+    }
+
+    u8 read_u8() { return m_cursor < m_data.size() ? m_data[m_cursor++] : 0; }
+
+    u64 read_varint() {
+        u64 value = 0;
+        for (u32 shift = 0; m_cursor < m_data.size() && shift < 64; shift += 7) {
+            u8 byte = m_data[m_cursor++];
+            value |= static_cast<u64>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+
+        return value;
+    }
+
+    i64 read_signed() {
+        auto value = read_varint();
+        return static_cast<i64>(value >> 1) ^ -static_cast<i64>(value & 1);
+    }
+
+    u32 read_u32() {
+        u32 value = 0;
+        if (m_cursor + 4 <= m_data.size()) {
+            std::memcpy(&value, m_data.data() + m_cursor, 4);
+        }
+        m_cursor += 4;
+        return value;
+    }
+
+    f32 read_f32() {
+        f32 value = 0.0f;
+        if (m_cursor + 4 <= m_data.size()) {
+            std::memcpy(&value, m_data.data() + m_cursor, 4);
+        }
+        m_cursor += 4;
+        return value;
+    }
+
+    std::vector<u8> m_data;
+    usize m_cursor = 0;
+    std::optional<u64> m_next_tick;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "assert.h"
+#include "defines.h"
+#include "Recording.h"
+#include "engine/Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <vector>
+
+// ring buffer of the simulation state after every tick, used to rewind a match. the state is an
+// opaque blob written by the scene. every keyframe_interval ticks it is stored in full, the
+// ticks in between only store the 8 byte words that changed since the previous tick:
+//
+// delta: word count as u64, then segments of u32 unchanged words, u32 changed words and the
+// changed words xor the previous state. most components and every resting body stay the same
+// between two ticks, so deltas are a fraction of the full state.
+//
+// next to the state every tick keeps the ship commands and spawns it had, rewound ticks are
+// simulated again from them without running lua.
+
+// plain copies of trivially copyable values into and out of checkpoint states
+template <class T> void checkpoint_put(std::vector<u8> &out, const T &value) {
+    auto bytes = reinterpret_cast<const u8 *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <class T> T checkpoint_get(std::span<const u8> in, usize &cursor) {
+    always_assert(cursor + sizeof(T) <= in.size(), "rollback checkpoint is truncated");
+
+    T value;
+    std::memcpy(&value, in.data() + cursor, sizeof(T));
+    cursor += sizeof(T);
+    return value;
+}
+
+struct RollbackSettings {
+    // ticks that can be rewound, 0 disables checkpoints
+    u32 capacity = 0;
+    u32 keyframe_interval = 30;
+    // how far the rewind key goes back
+    u32 rewind_ticks = 2 * 60;
+};
+
+enum struct RewindMode : u8 {
+    // the rewound ticks run again with the commands the scripts gave in them, scripts take over
+    // again once the simulation is back at the tick the rewind started from
+    Resimulate = 0,
+    // scripts take over right away from the restored state, the logged commands are dropped
+    Branch = 1,
+};
+
+class RollbackBuffer {
+  public:
+    void reset(const RollbackSettings &settings) {
+        m_keyframe_interval = std::max<u32>(settings.keyframe_interval, 1);
+        m_slots.clear();
+        m_slots.resize(settings.capacity);
+        m_previous.clear();
+        m_previous_step = 0;
+        m_stored_bytes = 0;
+    }
+
+    bool enabled() const { return !m_slots.empty(); }
+
+    // the furthest a rewind is guaranteed to reach once the buffer is full, the keyframe the
+    // oldest ticks depend on may already be overwritten
+    u64 max_rewind() const {
+        return m_slots.size() > m_keyframe_interval ? m_slots.size() - m_keyframe_interval : 0;
+    }
+
+    // full and delta checkpoints currently held
+    u64 stored_bytes() const { return m_stored_bytes; }
+
+    // commands and spawns of step, kept until the slot is reused
+    TickRecord &log(u64 step) { return slot(step).log; }
+
+    // starts the log of a tick that is simulated for the first time
+    void begin_tick(u64 step) {
+        auto &checkpoint = slot(step);
+        checkpoint.log.clear();
+        checkpoint.step = 0;
+    }
+
+    // stores the state after step. state must be a whole number of 8 byte words
+    void store(u64 step, std::span<const u8> state) {
+        PROFILE_SCOPE("rollback checkpoint");
+        debug_assert(state.size() % sizeof(u64) == 0, "rollback state must be word aligned");
+
+        auto &checkpoint = slot(step);
+        m_stored_bytes -= checkpoint.data.size();
+
+        const bool has_base = !m_previous.empty() && m_previous_step + 1 == step;
+        checkpoint.step = step;
+        checkpoint.keyframe = !has_base || step % m_keyframe_interval == 0;
+        checkpoint.data.clear();
+
+        if (checkpoint.keyframe) {
+            checkpoint.data.assign(state.begin(), state.end());
+        } else {
+            encode_delta(m_previous, state, checkpoint.data);
+        }
+
+        m_stored_bytes += checkpoint.data.size();
+        m_previous.assign(state.begin(), state.end());
+        m_previous_step = step;
+    }
+
+    // decodes the state after step into out, false if it is no longer in the buffer
+    bool load(u64 step, std::vector<u8> &out) {
+        if (!enabled() || step == 0)
+            return false;
+
+        // walk back to the keyframe the delta chain starts at
+        u64 keyframe_step = step;
+        for (usize walked = 0;; ++walked) {
+            const auto &checkpoint = slot(keyframe_step);
+            if (walked >= m_slots.size() || keyframe_step == 0 ||
+                checkpoint.step != keyframe_step)
+                return false;
+
+            if (checkpoint.keyframe)
+                break;
+
+            --keyframe_step;
+        }
+
+        out.assign(slot(keyframe_step).data.begin(), slot(keyframe_step).data.end());
+        for (auto current = keyframe_step + 1; current <= step; ++current) {
+            apply_delta(slot(current).data, out);
+        }
+
+        return true;
+    }
+
+    // the next stored tick continues from state, which was restored at step
+    void rewound_to(u64 step, std::span<const u8> state) {
+        m_previous.assign(state.begin(), state.end());
+        m_previous_step = step;
+    }
+
+  private:
+    struct Checkpoint {
+        // 0 while the slot holds no state
+        u64 step = 0;
+        bool keyframe = false;
+        std::vector<u8> data;
+        TickRecord log;
+    };
+
+    Checkpoint &slot(u64 step) { return m_slots[step % m_slots.size()]; }
+
+    static u64 word_at(std::span<const u8> bytes, usize index) {
+        u64 word = 0;
+        if ((index + 1) * sizeof(u64) <= bytes.size()) {
+            std::memcpy(&word, bytes.data() + index * sizeof(u64), sizeof(u64));
+        }
+
+        return word;
+    }
+
+    static void encode_delta(std::span<const u8> previous, std::span<const u8> state,
+                             std::vector<u8> &out) {
+        const usize words = state.size() / sizeof(u64);
+        checkpoint_put<u64>(out, words);
+
+        usize i = 0;
+        while (i < words) {
+            const usize unchanged_start = i;
+            while (i < words && word_at(state, i) == word_at(previous, i)) {
+                ++i;
+            }
+
+            const usize changed_start = i;
+            while (i < words && word_at(state, i) != word_at(previous, i)) {
+                ++i;
+            }
+
+            checkpoint_put(out, static_cast<u32>(changed_start - unchanged_start));
+            checkpoint_put(out, static_cast<u32>(i - changed_start));
+
+            for (usize j = changed_start; j < i; ++j) {
+                checkpoint_put(out, word_at(state, j) ^ word_at(previous, j));
+            }
+        }
+    }
+
+    // turns the previous state in out into the state the delta was taken of
+    static void apply_delta(std::span<const u8> delta, std::vector<u8> &out) {
+        usize cursor = 0;
+        const auto words = checkpoint_get<u64>(delta, cursor);
+        out.resize(words * sizeof(u64), 0);
+
+        usize word = 0;
+        while (cursor < delta.size()) {
+            const auto unchanged = checkpoint_get<u32>(delta, cursor);
+            const auto changed = checkpoint_get<u32>(delta, cursor);
+
+            word += unchanged;
+            always_assert(word + changed <= words, "corrupt rollback delta");
+
+            for (u32 i = 0; i < changed; ++i, ++word) {
+                const auto difference = checkpoint_get<u64>(delta, cursor);
+
+                u64 value = 0;
+                std::memcpy(&value, out.data() + word * sizeof(u64), sizeof(value));
+                value ^= difference;
+                std::memcpy(out.data() + word * sizeof(u64), &value, sizeof(value));
+            }
+        }
+    }
+
+    std::vector<Checkpoint> m_slots;
+    u32 m_keyframe_interval = 30;
+
+    // full state of the last stored tick, deltas are taken against it
+    std::vector<u8> m_previous;
+    u64 m_previous_step = 0;
+
+    u64 m_stored_bytes = 0;
+};
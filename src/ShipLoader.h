@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <chipmunk/chipmunk.h>
+#include <sol/sol.hpp>
+
+#include "engine/AssetManager.h"
+#include "engine/WorkerPool.h"
+
+#include "Recording.h"
+#include "defines.h"
+
+enum struct BlockType {
+    Hub = 0,
+    Hull = 1,
+    Thruster = 2,
+    Radar = 3,
+    Gun = 4,
+};
+
+inline cpVect get_block_dimensions(BlockType type) {
+    switch (type) {
+    case BlockType::Hub:
+    case BlockType::Hull:
+    case BlockType::Radar:
+    case BlockType::Gun:
+        return cpVect{.x = 32, .y = 32};
+    case BlockType::Thruster:
+        return cpVect{.x = 16, .y = 32};
+    }
+}
+
+// position of a block relative to the hub, blocks sit on a 32 unit grid
+inline cpVect get_block_offset(BlockType type, i32 dx, i32 dy) {
+    auto dimensions = get_block_dimensions(type);
+    return cpVect{.x = dx * 32.0 + (32.0 - dimensions.x) / 2.0,
+                  .y = dy * 32.0 + (32.0 - dimensions.y) / 2.0};
+}
+
+inline void set_block_globals(sol::state &lua) {
+    lua["BLOCK_HUB"] = BlockType::Hub;
+    lua["BLOCK_HULL"] = BlockType::Hull;
+    lua["BLOCK_THRUSTER"] = BlockType::Thruster;
+    lua["BLOCK_RADAR"] = BlockType::Radar;
+    lua["BLOCK_GUN"] = BlockType::Gun;
+}
+
+// two blocks of a ship held together by springs, indices into the placed blocks. a is always
+// the block placed later
+struct BlockJoint {
+    u32 a, b;
+};
+
+// joins every block to its direct and diagonal neighbours. returns why the layout is invalid
+// instead of joining anything if the hub is not placed first or blocks overlap
+inline std::optional<std::string> plan_joints(const ShipSpawnRecord &spawn,
+                                              std::vector<BlockJoint> &joints) {
+    joints.clear();
+
+    const auto &blocks = spawn.blocks;
+    if (blocks.empty() || static_cast<BlockType>(blocks.front().type) != BlockType::Hub) {
+        return "hub must be placed first";
+    }
+
+    std::vector<cpVect> offsets;
+    offsets.reserve(blocks.size());
+
+    for (u32 i = 0; i < blocks.size(); ++i) {
+        auto type = static_cast<BlockType>(blocks[i].type);
+        if (i > 0 && type == BlockType::Hub) {
+            return "only one hub per ship allowed";
+        }
+
+        auto offset = get_block_offset(type, blocks[i].dx, blocks[i].dy);
+
+        for (u32 j = 0; j < i; ++j) {
+            auto distance_sq = cpvlengthsq(cpvsub(offsets[j], offset));
+            if (distance_sq <= 0.1) {
+                return "cant place blocks on top of each other";
+            }
+
+            if (distance_sq <= 32.5 * 32.5) {
+                joints.push_back(BlockJoint{.a = i, .b = j});
+            }
+        }
+
+        offsets.push_back(offset);
+    }
+
+    return std::nullopt;
+}
+
+// a dropped ship script, read, compiled and constructed on a worker. the chunk is kept as
+// bytecode, so the simulation thread only loads it instead of parsing the source again
+struct ShipBlueprint {
+    ShipSpawnRecord spawn;
+    std::vector<BlockJoint> joints;
+    std::string chunk_name;
+    std::string bytecode;
+};
+
+// loads ship scripts on the worker pool. construct runs in a scratch lua state where place only
+// records the layout, the finished blueprints are picked up by the simulation thread between
+// ticks. the queue is shared with the jobs, so it outlives a scene that is left mid load
+class ShipLoader {
+  public:
+    // the ship is placed at x, y once it is loaded
+    void load(WorkerPool &workers, const AssetManager &assets, const std::string &path, f32 x,
+              f32 y) {
+        auto queue = m_queue;
+
+        u64 sequence;
+        {
+            std::lock_guard lock(queue->mutex);
+            sequence = queue->next_sequence++;
+            ++queue->pending;
+        }
+
+        workers.submit([queue, &assets, path, x, y, sequence]() {
+            auto blueprint = build_blueprint(assets, path, x, y);
+
+            {
+                std::lock_guard lock(queue->mutex);
+                --queue->pending;
+                if (blueprint) {
+                    queue->ready.push_back(
+                        Loaded{.sequence = sequence, .blueprint = std::move(*blueprint)});
+                }
+            }
+
+            queue->condition.notify_all();
+        });
+    }
+
+    // appends the finished blueprints to out, in the order their loads were started
+    void take_ready(std::vector<ShipBlueprint> &out) {
+        std::lock_guard lock(m_queue->mutex);
+        if (m_queue->ready.empty())
+            return;
+
+        std::sort(m_queue->ready.begin(), m_queue->ready.end(),
+                  [](const Loaded &a, const Loaded &b) { return a.sequence < b.sequence; });
+
+        for (auto &loaded : m_queue->ready) {
+            out.push_back(std::move(loaded.blueprint));
+        }
+        m_queue->ready.clear();
+    }
+
+    // blocks until every started load finished, for tools that need all ships up front
+    void wait() {
+        std::unique_lock lock(m_queue->mutex);
+        m_queue->condition.wait(lock, [this]() { return m_queue->pending == 0; });
+    }
+
+  private:
+    struct Loaded {
+        u64 sequence;
+        ShipBlueprint blueprint;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<Loaded> ready;
+        u64 next_sequence = 0;
+        usize pending = 0;
+    };
+
+    static int write_bytecode(lua_State *, const void *data, size_t size, void *out) {
+        static_cast<std::string *>(out)->append(static_cast<const char *>(data), size);
+        return 0;
+    }
+
+    static std::optional<ShipBlueprint> build_blueprint(const AssetManager &assets,
+                                                        const std::string &path, f32 x, f32 y) {
+        // ship scripts bundled with the game are read from the asset archive
+        auto source = assets.read_file(path);
+        if (!source) {
+            std::cerr << "Cant read dropped file: " << path << std::endl;
+            return std::nullopt;
+        }
+
+        ShipBlueprint blueprint{
+            .spawn = ShipSpawnRecord{.name = {}, .x = x, .y = y, .blocks = {}},
+            .joints = {},
+            .chunk_name = "@" + path,
+            .bytecode = {},
+        };
+
+        sol::state lua;
+        lua.open_libraries(sol::lib::base, sol::lib::coroutine, sol::lib::math, sol::lib::table);
+        set_block_globals(lua);
+
+        sol::load_result chunk = lua.load(*source, blueprint.chunk_name);
+        if (!chunk.valid()) {
+            sol::error error = chunk;
+            std::cerr << "Invalid lua file dropped: " << error.what() << std::endl;
+            return std::nullopt;
+        }
+
+        sol::protected_function script = chunk;
+        script.push();
+        lua_dump(lua.lua_state(), write_bytecode, &blueprint.bytecode);
+        lua_pop(lua.lua_state(), 1);
+
+        sol::protected_function_result result = script();
+        if (!result.valid() || result.get_type() != sol::type::table) {
+            std::cerr << "Invalid lua file dropped: " << path << std::endl;
+            return std::nullopt;
+        }
+
+        sol::table table = result;
+        auto name = table.get<sol::optional<std::string>>("name");
+        if (!name) {
+            std::cerr << "No name" << std::endl;
+            return std::nullopt;
+        }
+
+        sol::protected_function construct = table["construct"];
+        if (!construct.valid()) {
+            std::cerr << "No construct fn" << std::endl;
+            return std::nullopt;
+        }
+
+        sol::protected_function update = table["update"];
+        sol::protected_function run = table["run"];
+        if (!update.valid() && !run.valid()) {
+            std::cerr << "No update or run fn" << std::endl;
+            return std::nullopt;
+        }
+
+        blueprint.spawn.name = *name;
+
+        // place hands out placement indices here, the scene spawns the blocks with contiguous ids
+        // in the same order and its place maps every index to one of them
+        auto &blocks = blueprint.spawn.blocks;
+        lua.set_function("place", [&blocks](BlockType type, i32 dx, i32 dy) {
+            blocks.push_back(BlockPlacement{.type = static_cast<u8>(type), .dx = dx, .dy = dy});
+            return blocks.size();
+        });
+
+        // block handles only exist in the scene, construct gets the index back here
+        for (auto handle : {"gun_handle", "radar_handle", "thruster_handle"}) {
+            lua.set_function(handle, [](usize id) { return id; });
+        }
+
+        auto constructed = construct();
+        if (!constructed.valid()) {
+            sol::error error = constructed;
+            std::cerr << "[" << *name << "]: Error: " << error.what() << std::endl;
+            return std::nullopt;
+        }
+
+        if (auto error = plan_joints(blueprint.spawn, blueprint.joints)) {
+            std::cerr << "[" << *name << "]: Error: " << *error << std::endl;
+            return std::nullopt;
+        }
+
+        return blueprint;
+    }
+
+    std::shared_ptr<Queue> m_queue = std::make_shared<Queue>();
+};
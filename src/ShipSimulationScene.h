@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <chipmunk/chipmunk_types.h>
 #include <chipmunk/cpVect.h>
 #include <iostream>
@@ -15,7 +17,16 @@
 
 #include "engine/EngineApi.h"
 #include "engine/IScene.h"
-
+#include "engine/Profiler.h"
+#include "engine/RenderSnapshot.h"
+#include "engine/SpriteBatch.h"
+
+#include "PhysicsPool.h"
+#include "Recording.h"
+#include "Rollback.h"
+#include "ShipLoader.h"
+#include "SpatialGrid.h"
+#include "StateStream.h"
 #include "ecs.h"
 
 const f64 RAD2DEG = 180.0 / std::numbers::pi_v<f64>;
@@ -25,32 +36,27 @@ struct RigidBody {
     cpBody *body;
     cpVect relative_position;
 
+    // the single box shape of the body and its size, kept so checkpoints never walk the shapes
+    cpShape *shape = nullptr;
+    cpVect size = cpvzero;
+
+    // state before the last physics step, used to interpolate rendering between ticks
+    cpVect previous_position = cpvzero;
+    f32 previous_rotation = 0.0f;
+
     cpVect position() const { return cpBodyGetPosition(body); }
     cpVect velocity() const { return cpBodyGetVelocity(body); }
     cpVect direction() const { return cpBodyGetRotation(body); }
 
     f32 rotation() const { return cpBodyGetAngle(body); }
-};
 
-enum struct BlockType {
-    Hub = 0,
-    Hull = 1,
-    Thruster = 2,
-    Radar = 3,
-    Gun = 4,
+    void store_previous_state() {
+        previous_position = position();
+        previous_rotation = rotation();
+    }
 };
 
-inline cpVect get_block_dimensions(BlockType type) {
-    switch (type) {
-    case BlockType::Hub:
-    case BlockType::Hull:
-    case BlockType::Radar:
-    case BlockType::Gun:
-        return cpVect{.x = 32, .y = 32};
-    case BlockType::Thruster:
-        return cpVect{.x = 16, .y = 32};
-    }
-}
+const cpVect PROJECTILE_DIMENSIONS{.x = 32, .y = 4};
 
 struct Sprite {
     AssetHandle handle;
@@ -60,247 +66,721 @@ struct ShipId {
     EntityId id;
 };
 
-struct ShipBrain {};
+enum struct ShipLod : u8 {
+    Full = 0,
+    // nothing nearby, the script runs every few ticks
+    Reduced = 1,
+    // nothing nearby and barely moving, the bodies sleep and the script does not run
+    Asleep = 2,
+};
+
+struct ShipBrain {
+    ShipLod lod = ShipLod::Full;
+    // consecutive lod checks that found nothing nearby
+    u32 isolated_checks = 0;
+    // ticks since the script last ran and the simulated time that passed in them
+    u32 skipped_ticks = 0;
+    f32 accumulated_dt = 0.0f;
+};
+// actuators keep what the script last set, native systems apply it every tick
 struct ShipThruster {
     f64 max_thrust;
+    // percentage of max_thrust, 0 to 100
+    f32 throttle = 0.0f;
 };
 
 struct ShipRadar {
     AssetHandle dish_handle;
     f32 rotation;
     f32 rotation_speed;
-    bool rotated = false;
+    // turn rate in percent of rotation_speed, -100 to 100, used while not aiming
+    f32 turn = 0.0f;
+    bool aiming = false;
+    f32 target_rotation = 0.0f;
+    // result of the last radar sweep, 0 when the ray did not hit anything
+    f32 ping_distance = 0.0f;
 };
 
 struct Lifetime {
     f32 until;
 };
 
+struct Health {
+    f32 hit_points;
+};
+
+const f32 BLOCK_HIT_POINTS = 100.0f;
+const f32 PROJECTILE_DAMAGE = 25.0f;
+const Health BLOCK_HEALTH{.hit_points = BLOCK_HIT_POINTS};
+
+// chipmunk collision types, bodies carry their entity id as user data
+enum CollisionType : cpCollisionType {
+    COLLISION_BLOCK = 1,
+    COLLISION_PROJECTILE = 2,
+};
+
+// one projectile hitting a block, appended by the collision handler during the physics step
+struct ContactRecord {
+    EntityId projectile;
+    EntityId block;
+    f32 impulse;
+    cpVect point;
+};
+
 struct ShipGun {
     AssetHandle gun_handle;
     f32 rotation;
     f32 rotation_speed;
     f32 cooldown;
     f32 last_shot;
-    bool rotated = false;
+    f32 turn = 0.0f;
+    bool aiming = false;
+    f32 target_rotation = 0.0f;
+};
+
+// turns a radar or gun by its turn rate, or along the shorter way towards its aim target
+template <class Turret> void step_turret(Turret &turret) {
+    if (!turret.aiming) {
+        turret.rotation += turret.rotation_speed * turret.turn / 100.0f;
+        return;
+    }
+
+    auto difference = std::remainder(turret.target_rotation - turret.rotation,
+                                     2.0f * std::numbers::pi_v<f32>);
+    turret.rotation += std::clamp(difference, -turret.rotation_speed, turret.rotation_speed);
+}
+
+// typed handle to an actuator block of the current ship, see gun_handle and friends. it keeps
+// pointers into the archetype columns, so methods called on it skip the id lookup until the
+// rows of the archetype move
+template <class Actuator> struct BlockHandle {
+    EntityRef<const ShipId, const RigidBody, Actuator> ref;
 };
 
 struct ShipScript {
     std::string name;
     std::vector<RigidBody> parts;
     sol::protected_function update;
+    // blocks joined by springs. kept when blocks die, rollback rebuilds the joints of the living
+    std::vector<std::pair<EntityId, EntityId>> joints;
+
+    // optional run function, resumed as a coroutine on every tick the script runs and started
+    // again once it returns. it yields to continue on the next tick
+    sol::protected_function run_function;
+    sol::thread run_thread;
+    sol::coroutine run;
+    // wall time of the last resume
+    u64 run_ns = 0;
+};
+
+// script of a destroyed ship, kept while a rewind could bring the ship back
+struct FallenShip {
+    u64 step;
+    ShipScript script;
+};
+
+// a loaded ship while its construct runs again in the scene state. place checks every block
+// against the layout the worker recorded and hands out the id the block was spawned with
+struct ShipPlacement {
+    const ShipSpawnRecord *spawn = nullptr;
+    EntityRange ids{};
+    usize placed = 0;
+    bool diverged = false;
+};
+
+// everything needed to create a body again, every body has a single box shape
+struct BodyCheckpoint {
+    cpVect position, velocity;
+    cpFloat angle, angular_velocity;
+    cpFloat mass, moment;
+    cpVect size;
+    cpGroup group;
+    cpCollisionType collision_type;
+};
+
+struct Projectile {
+    EntityId ship_id;
+};
+
+const f64 RADAR_RANGE = 2000.0;
+
+// how far outside of the view sprites are still kept. covers the largest sprite half diagonal,
+// one tick of movement and the camera moving between the interpolated frames
+const f64 CULL_MARGIN = 64.0;
+
+// mass removals leave archetypes mostly empty, their memory is given back this often
+const u64 WORLD_COMPACT_INTERVAL = 10 * TICKS_PER_SECOND;
+
+// archetypes listed in the debug overlay, the largest first
+const usize OVERLAY_ARCHETYPES = 8;
+
+// textures of all ship blocks, loaded once when the scene is entered
+struct BlockTextures {
+    AssetHandle hub;
+    AssetHandle hull;
+    AssetHandle thruster;
+    AssetHandle radar_base;
+    AssetHandle radar_dish;
+    AssetHandle gun_base;
+    AssetHandle gun_gun;
+};
+
+// archetypes of everything the scene spawns, resolved once per world
+struct SceneArchetypes {
+    ArchetypeHandle<RigidBody, Sprite, ShipId, ShipBrain, Health> hub;
+    ArchetypeHandle<RigidBody, ShipId, ShipThruster, Sprite, Health> thruster;
+    ArchetypeHandle<RigidBody, ShipId, ShipRadar, Sprite, Health> radar;
+    ArchetypeHandle<RigidBody, ShipId, ShipGun, Sprite, Health> gun;
+    ArchetypeHandle<RigidBody, ShipId, Sprite, Health> hull;
+    ArchetypeHandle<RigidBody, Sprite, Lifetime, Projectile> projectile;
+};
+
+// wall time of the parts of the last update, read by the benchmark runner
+struct TickTimings {
+    u64 lua_ns = 0;
+    u64 physics_ns = 0;
+    // saving the rollback checkpoint, 0 while rollback is disabled
+    u64 checkpoint_ns = 0;
+    u64 total_ns = 0;
+};
+
+// lua collector tuning, pause and step_multiplier are the lua 5.1 LUA_GCSETPAUSE/SETSTEPMUL
+// percentages
+struct LuaGcSettings {
+    i32 pause = 150;
+    i32 step_multiplier = 200;
+    // work of one idle step in kilobytes, small enough to check the clock often
+    i32 idle_step_kb = 8;
+    // idle time left untouched, so collecting never delays the next tick
+    u64 idle_reserve_ns = 1'000'000;
+};
+
+struct LuaGcStats {
+    // lua heap at the end of the last update
+    u64 memory_bytes = 0;
+    // heap growth during the scripts of the last update, negative if the collector ran in them
+    i64 update_delta_bytes = 0;
+    // collector work done in the idle time after the last tick
+    u64 idle_ns = 0;
+    u32 idle_steps = 0;
+    // updates so far in which the collector ran inside the scripts
+    u64 collections_in_update = 0;
+};
+
+// ships with nothing else within radius run their script less often and can be put to sleep
+// in chipmunk until something comes close again
+struct LodSettings {
+    bool enabled = true;
+    // beyond the radar range, so an isolated ship could not have sensed anything anyway
+    f64 radius = RADAR_RANGE + 500.0;
+    // ticks between two checks of a ship, ships are checked on different ticks
+    u32 check_interval = 15;
+    // isolated ships run their script every this many ticks
+    u32 script_interval = 10;
+    // consecutive isolated checks before a slow ship is put to sleep, 0 never sleeps
+    u32 sleep_after_checks = 8;
+    // hub speed below which an isolated ship counts as slow
+    f64 sleep_speed = 5.0;
+};
+
+struct LodStats {
+    u32 full = 0;
+    u32 reduced = 0;
+    u32 asleep = 0;
+};
+
+struct CoroutineStats {
+    // coroutines resumed in the last update
+    u32 resumed = 0;
+    u64 total_ns = 0;
+    u64 max_ns = 0;
 };
 
-struct Projectile {};
+struct SimulationOptions {
+    // write every input and ship command to this file
+    std::string record_path;
+    // drive the simulation from this recording instead of lua scripts
+    std::string replay_path;
+
+    // publish the state of every tick to this file, or to a unix socket with a unix: prefix
+    std::string stream_path;
+
+    LuaGcSettings gc;
+    LodSettings lod;
+    RollbackSettings rollback;
+
+    // time the run coroutine of every ship gets per tick before yield_if_over_budget yields
+    u64 coroutine_budget_ns = 250'000;
+};
 
 struct ShipSimulationScene : public IScene {
     World m_world;
+    SceneArchetypes m_archetypes;
 
-    cpSpace *m_space;
+    // every body, shape and constraint in m_space lives in the pool
+    PhysicsPool m_physics;
+    cpSpace *m_space = nullptr;
 
     AssetHandle m_gun_shot_texture;
+    BlockTextures m_block_textures;
 
     std::unordered_map<EntityId, ShipScript> m_ships;
     sol::state m_lua;
 
+    SpatialGrid<> m_spatial;
+    std::vector<SpatialEntry> m_nearest_scratch;
+
+    std::vector<std::tuple<EntityId, cpVect, f32>> m_shots_to_spawn;
+
+    StateStreamWriter m_stream;
+
+    ShipLoader m_ship_loader;
+    std::vector<ShipBlueprint> m_loaded_ships;
+    ShipPlacement m_placement;
+    std::vector<BlockJoint> m_recorded_joints;
+
+    // filled during the physics step and kept until the next one
+    std::vector<ContactRecord> m_contacts;
+
     f32 camera_x, camera_y;
+    f32 previous_camera_x, previous_camera_y;
+
+    SimulationOptions m_options;
+    CommandRecorder m_recorder;
+    CommandReplay m_replay;
+    bool m_replaying = false;
+    TickRecord m_tick_record;
+
+    // counts scene updates. unlike the engine tick it does not skip dropped ticks, recordings
+    // are keyed by it so replays line up no matter how fast they run
+    u64 m_step = 0;
+
+    TickTimings m_timings;
+
+    LuaGcStats m_gc_stats;
+    // heap size after the last finished collection cycle and whether idle steps are in a cycle
+    u64 m_gc_baseline_bytes = 0;
+    bool m_gc_cycle_running = false;
+
+    // the ship whose script is currently running, 0 outside of run_ship_scripts
+    EntityId m_current_ship = 0;
+    RigidBody m_current_body{};
+    // time since the current script last ran, more than a tick for isolated ships
+    f32 m_current_dt = 0.0f;
+    // wall time the run coroutine of the current ship took on its last tick
+    u64 m_current_run_ns = 0;
+    // profiler_now_ns at which the running coroutine is over its budget, 0 outside of one
+    u64 m_coroutine_deadline = 0;
+    CoroutineStats m_coroutine_stats;
+    usize m_ships_count = 0;
+
+    LodStats m_lod_stats;
+    std::vector<ArchetypeMemoryStats> m_archetype_memory;
+
+    RollbackBuffer m_rollback;
+    std::vector<u8> m_checkpoint;
+    std::unordered_map<EntityId, FallenShip> m_fallen_ships;
+    // rewound ticks up to this step replay their logged commands instead of running scripts
+    u64 m_resimulate_until = 0;
+
+    // only used on the render thread
+    SpriteBatch m_batch;
+
+    ShipSimulationScene() = default;
+    explicit ShipSimulationScene(const SimulationOptions *options) : m_options(*options) {}
 
     void on_enter(EngineApi &api) override {
-        m_lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::table);
-        m_lua["BLOCK_HUB"] = BlockType::Hub;
-        m_lua["BLOCK_HULL"] = BlockType::Hull;
-        m_lua["BLOCK_THRUSTER"] = BlockType::Thruster;
-        m_lua["BLOCK_RADAR"] = BlockType::Radar;
-        m_lua["BLOCK_GUN"] = BlockType::Gun;
+        m_lua.open_libraries(sol::lib::base, sol::lib::coroutine, sol::lib::math,
+                             sol::lib::table);
+        set_block_globals(m_lua);
+        register_ship_api(api);
+
+        // collection is mostly driven from idle time, the automatic collector is the fallback
+        // for when ticks never finish early
+        lua_gc(m_lua.lua_state(), LUA_GCSETPAUSE, m_options.gc.pause);
+        lua_gc(m_lua.lua_state(), LUA_GCSETSTEPMUL, m_options.gc.step_multiplier);
+        m_gc_stats = LuaGcStats{};
+        m_gc_baseline_bytes = lua_memory_bytes();
 
         camera_x = camera_y = 0.0f;
+        previous_camera_x = previous_camera_y = 0.0f;
 
         m_world = World{};
+        m_archetypes = SceneArchetypes{
+            .hub = m_world.archetype<RigidBody, Sprite, ShipId, ShipBrain, Health>(),
+            .thruster = m_world.archetype<RigidBody, ShipId, ShipThruster, Sprite, Health>(),
+            .radar = m_world.archetype<RigidBody, ShipId, ShipRadar, Sprite, Health>(),
+            .gun = m_world.archetype<RigidBody, ShipId, ShipGun, Sprite, Health>(),
+            .hull = m_world.archetype<RigidBody, ShipId, Sprite, Health>(),
+            .projectile = m_world.archetype<RigidBody, Sprite, Lifetime, Projectile>(),
+        };
         m_space = cpSpaceNew();
+        m_contacts.clear();
 
-        m_gun_shot_texture = api.assets.textures.load("./assets/gameplay/gun_shot.bmp");
-
-        auto ship_hub_texture = api.assets.textures.load("./assets/gameplay/ship_block_hub.bmp");
-        auto ship_hull_texture = api.assets.textures.load("./assets/gameplay/ship_block_hull.bmp");
-        auto ship_thruster_texture =
-            api.assets.textures.load("./assets/gameplay/ship_block_thruster.bmp");
-        auto ship_radar_base_texture =
-            api.assets.textures.load("./assets/gameplay/ship_block_radar_base.bmp");
-        auto ship_radar_dish_texture =
-            api.assets.textures.load("./assets/gameplay/ship_block_radar_dish.bmp");
-        auto ship_gun_base_texture =
-            api.assets.textures.load("./assets/gameplay/ship_block_gun_base.bmp");
-        auto ship_gun_gun_texture =
-            api.assets.textures.load("./assets/gameplay/ship_block_gun_gun.bmp");
-
-        api.on_file_dropped = [&, this, ship_hub_texture, ship_hull_texture,
-                               ship_radar_base_texture, ship_radar_dish_texture,
-                               ship_thruster_texture, ship_gun_base_texture,
-                               ship_gun_gun_texture](const char *file_path, f32 cx, f32 cy) {
-            cx += camera_x;
-            cy += camera_y;
-
-            auto script =
-                m_lua.script_file(file_path, [](lua_State *, sol::protected_function_result pfr) {
-                    std::cerr << "Invalid lua file dropped" << std::endl;
-                    return pfr;
-                });
+        auto handler = cpSpaceAddCollisionHandler(m_space, COLLISION_PROJECTILE, COLLISION_BLOCK);
+        handler->postSolveFunc = record_contact;
+        handler->userData = this;
 
-            if (!script.valid()) {
-                std::cerr << "Invalid lua file dropped" << std::endl;
-                return;
-            }
+        // cpBodySleep needs sleeping enabled. without gravity chipmunk only puts bodies to sleep
+        // on its own when they are perfectly still, update_ship_lod wakes those again unless
+        // the lod put the ship to sleep
+        if (m_options.lod.enabled && m_options.lod.sleep_after_checks > 0) {
+            cpSpaceSetSleepTimeThreshold(m_space, 1.0);
+        }
 
-            sol::table table = script;
-            auto name = table.get<sol::optional<std::string>>("name");
+        m_spatial.clear();
+        m_step = 0;
 
-            if (!name) {
-                std::cerr << "No name" << std::endl;
-                return;
-            }
+        m_rollback.reset(m_options.rollback);
+        m_fallen_ships.clear();
+        m_resimulate_until = 0;
 
-            sol::protected_function construct = table["construct"];
-            if (!construct.valid()) {
-                std::cerr << "No construct fn" << std::endl;
-                return;
+        if (!m_options.replay_path.empty()) {
+            m_replaying = m_replay.open(m_options.replay_path);
+            if (!m_replaying) {
+                std::cerr << "Cant open replay: " << m_options.replay_path << std::endl;
+                m_options.replay_path.clear();
+            }
+        } else if (!m_options.record_path.empty()) {
+            if (!m_recorder.open(m_options.record_path)) {
+                std::cerr << "Cant open recording: " << m_options.record_path << std::endl;
             }
+        }
 
-            sol::protected_function update = table["update"];
-            if (!update.valid()) {
-                std::cerr << "No update fn" << std::endl;
+        // all gameplay sprites live in one atlas, so each render layer is a single draw call.
+        // the images load in the background, nothing in the simulation depends on them
+        auto &atlas = api.assets.atlas;
+
+        // the state stream tells viewers which image every texture index stands for
+        std::vector<std::pair<AssetHandle, std::string>> textures;
+        const auto add_texture = [&](const char *path) {
+            textures.emplace_back(atlas.add(path), path);
+            return textures.back().first;
+        };
+
+        m_gun_shot_texture = add_texture("./assets/gameplay/gun_shot.bmp");
+
+        m_block_textures = BlockTextures{
+            .hub = add_texture("./assets/gameplay/ship_block_hub.bmp"),
+            .hull = add_texture("./assets/gameplay/ship_block_hull.bmp"),
+            .thruster = add_texture("./assets/gameplay/ship_block_thruster.bmp"),
+            .radar_base = add_texture("./assets/gameplay/ship_block_radar_base.bmp"),
+            .radar_dish = add_texture("./assets/gameplay/ship_block_radar_dish.bmp"),
+            .gun_base = add_texture("./assets/gameplay/ship_block_gun_base.bmp"),
+            .gun_gun = add_texture("./assets/gameplay/ship_block_gun_gun.bmp"),
+        };
+
+        if (!m_options.stream_path.empty() && !m_stream.open(m_options.stream_path, textures)) {
+            std::cerr << "Cant open state stream: " << m_options.stream_path << std::endl;
+        }
+
+        api.on_file_dropped = [&, this](const char *file_path, f32 cx, f32 cy) {
+            // a replay already contains every ship that was dropped during the recording
+            if (!m_options.replay_path.empty()) {
+                std::cerr << "Ignoring dropped file during replay" << std::endl;
                 return;
             }
 
-            cpVect center{.x = cx, .y = cy};
+            // reading, compiling and constructing happens on a worker, the ship is spawned at
+            // the start of the first tick after it finished
+            m_ship_loader.load(api.workers, api.assets, file_path, cx + camera_x, cy + camera_y);
+        };
 
-            EntityId ship_id = 0;
-            ShipScript *ship = nullptr;
+        // api.on_file_dropped("/Users/thekatze/Development/me-when-lua/assets/scripting/script.lua",
+        //                     64.0f, 64.0f);
+    }
 
-            m_lua.set_function("place", [&](BlockType type, int dx, int dy) {
-                EntityId block_id = 0;
+    void on_exit(EngineApi &api) override {
+        // chipmunk touches the bodies while freeing the space, they go back to the pool first
+        m_world.query<const RigidBody &>(
+            [this](EntityId id, const RigidBody &body) { destroy_body(body.body); });
+        cpSpaceFree(m_space);
+        m_space = nullptr;
+    }
 
-                auto dimensions = get_block_dimensions(type);
-                cpVect relative_pos{.x = dx * 32.0 + (32.0 - dimensions.x) / 2.0,
-                                    .y = dy * 32.0 + (32.0 - dimensions.y) / 2.0};
+    // spawns all blocks of a ship with their bodies and shapes, then adds the planned joints.
+    // the blocks get contiguous ids in placement order, the first block is the hub and its id is
+    // the ship
+    EntityRange spawn_ship(EngineApi &api, const ShipSpawnRecord &spawn,
+                           const std::vector<BlockJoint> &joints, sol::protected_function update) {
+        const cpVect center{.x = spawn.x, .y = spawn.y};
+        const EntityRange block_ids{.first = m_world.m_next_entity_id,
+                                    .count = spawn.blocks.size()};
+
+        ShipScript ship{.name = spawn.name, .parts = {}, .update = std::move(update)};
+        ship.parts.reserve(spawn.blocks.size());
+        EntityId ship_id = 0;
+
+        for (const auto &placement : spawn.blocks) {
+            auto type = static_cast<BlockType>(placement.type);
+            auto dimensions = get_block_dimensions(type);
+
+            auto mass = 1.0f;
+            auto moment = cpMomentForBox(mass, dimensions.x, dimensions.y);
+
+            RigidBody block{.body = cpSpaceAddBody(m_space, m_physics.body(mass, moment)),
+                            .relative_position =
+                                get_block_offset(type, placement.dx, placement.dy)};
+            auto shape = block.shape =
+                cpSpaceAddShape(m_space, m_physics.box(block.body, dimensions.x, dimensions.y));
+            block.size = dimensions;
+
+            cpBodySetPosition(block.body, cpvadd(center, block.relative_position));
+            cpBodySetAngle(block.body, 0);
+            block.store_previous_state();
+
+            EntityId block_id = 0;
+            switch (type) {
+            case BlockType::Hub: {
+                block_id = ship_id = m_world.spawn_in(m_archetypes.hub, block,
+                                                      Sprite{
+                                                          .handle = m_block_textures.hub,
+                                                      },
+                                                      ShipId{.id = 0}, ShipBrain{}, BLOCK_HEALTH);
+
+                // need to first spawn to be able to set the ship id
+                std::get<ShipId &>(*m_world.get<ShipId &>(ship_id)).id = ship_id;
+                break;
+            }
+            case BlockType::Thruster: {
+                block_id = m_world.spawn_in(m_archetypes.thruster, block, ShipId{.id = ship_id},
+                                            ShipThruster{.max_thrust = 50.0},
+                                            Sprite{
+                                                .handle = m_block_textures.thruster,
+                                            },
+                                            BLOCK_HEALTH);
+
+                break;
+            }
+            case BlockType::Radar: {
+                block_id = m_world.spawn_in(m_archetypes.radar, block, ShipId{.id = ship_id},
+                                            ShipRadar{
+                                                .dish_handle = m_block_textures.radar_dish,
+                                                .rotation = 0,
+                                                .rotation_speed = 8.0f * api.time.delta_time,
+                                            },
+                                            Sprite{
+                                                .handle = m_block_textures.radar_base,
+                                            },
+                                            BLOCK_HEALTH);
+                break;
+            }
+            case BlockType::Gun: {
+                block_id = m_world.spawn_in(m_archetypes.gun, block, ShipId{.id = ship_id},
+                                            ShipGun{
+                                                .gun_handle = m_block_textures.gun_gun,
+                                                .rotation = 0,
+                                                .rotation_speed = 3.0f * api.time.delta_time,
+                                                .cooldown = 0.8f,
+                                                .last_shot = api.time.elapsed,
+                                            },
+                                            Sprite{
+                                                .handle = m_block_textures.gun_base,
+                                            },
+                                            BLOCK_HEALTH);
+                break;
+            }
+            case BlockType::Hull: {
+                block_id = m_world.spawn_in(m_archetypes.hull, block, ShipId{.id = ship_id},
+                                            Sprite{
+                                                .handle = m_block_textures.hull,
+                                            },
+                                            BLOCK_HEALTH);
+                break;
+            }
+            }
 
-                auto mass = 1.0f;
-                auto moment = cpMomentForBox(mass, dimensions.x, dimensions.y);
+            debug_assert(ship_id != 0, "hub must be placed first");
+            debug_assert(block_id == block_ids[ship.parts.size()], "block ids must be contiguous");
 
-                RigidBody block{.body = cpSpaceAddBody(m_space, cpBodyNew(mass, moment)),
-                                .relative_position = relative_pos};
-                auto shape = cpSpaceAddShape(
-                    m_space, cpBoxShapeNew(block.body, dimensions.x, dimensions.y, 0));
+            cpShapeSetFilter(shape, cpShapeFilterNew(ship_id, 0xFFFFFFFF, 0xFFFFFFFF));
+            cpShapeSetCollisionType(shape, COLLISION_BLOCK);
+            cpBodySetUserData(block.body, reinterpret_cast<cpDataPointer>(block_id));
 
-                cpBodySetPosition(block.body, cpvadd(center, relative_pos));
-                cpBodySetAngle(block.body, 0);
+            ship.parts.push_back(block);
+        }
 
-                if (ship) {
-                    for (auto &part : ship->parts) {
-                        auto diff = cpvsub(part.relative_position, block.relative_position);
-                        auto distance_sq = cpvlengthsq(diff);
-                        always_assert(distance_sq > 0.1, "cant place blocks on top of each other");
+        ship.joints.reserve(joints.size());
+        for (const auto &joint : joints) {
+            add_joint(ship.parts[joint.a], ship.parts[joint.b]);
+            ship.joints.emplace_back(block_ids[joint.a], block_ids[joint.b]);
+        }
 
-                        if (distance_sq > 32.5 * 32.5)
-                            continue;
+        m_ships[ship_id] = std::move(ship);
+        return block_ids;
+    }
 
-                        auto half_diff = cpvmult(diff, 0.5);
-                        cpSpaceAddConstraint(m_space,
-                                             cpDampedSpringNew(block.body, part.body, half_diff,
-                                                               cpvneg(half_diff), 0, 3000, 10));
-                        cpSpaceAddConstraint(
-                            m_space, cpDampedRotarySpringNew(block.body, part.body, 0, 100000, 10));
-                    }
-                }
+    void add_joint(const RigidBody &a, const RigidBody &b) {
+        auto half_diff = cpvmult(cpvsub(b.relative_position, a.relative_position), 0.5);
+        cpSpaceAddConstraint(m_space, m_physics.damped_spring(a.body, b.body, half_diff,
+                                                              cpvneg(half_diff), 0, 3000, 10));
+        cpSpaceAddConstraint(m_space,
+                             m_physics.damped_rotary_spring(a.body, b.body, 0, 100000, 10));
+    }
 
-                switch (type) {
-                case BlockType::Hub: {
-                    always_assert(ship_id == 0, "only one hub per ship allowed");
-                    block_id = ship_id = m_world.spawn(block,
-                                                       Sprite{
-                                                           .handle = ship_hub_texture,
-                                                       },
-                                                       ShipId{.id = 0}, ShipBrain{});
-
-                    // need to first spawn to be able to set the ship id
-                    std::get<ShipId &>(*m_world.get<ShipId &>(ship_id)).id = ship_id;
-
-                    m_ships[ship_id] = ShipScript{
-                        .name = *name,
-                        .parts = {},
-                        .update = update,
-                    };
-
-                    ship = &m_ships[ship_id];
-                    break;
-                }
-                case BlockType::Thruster: {
-                    always_assert(ship_id != 0 && ship != nullptr, "hub must be placed first");
-                    block_id = m_world.spawn(block, ShipId{.id = ship_id},
-                                             ShipThruster{.max_thrust = 50.0},
-                                             Sprite{
-                                                 .handle = ship_thruster_texture,
-                                             });
+    // adds the ships that finished loading. the locals construct fills live in the lua state it
+    // ran in, so it runs once more in the scene state. place then maps the placement indices the
+    // worker handed out to the ids the blocks were spawned with, a ship whose construct fails or
+    // places different blocks than on the worker is removed again
+    void splice_loaded_ships(EngineApi &api) {
+        m_ship_loader.take_ready(m_loaded_ships);
+
+        for (const auto &blueprint : m_loaded_ships) {
+            sol::load_result chunk =
+                m_lua.load_buffer(blueprint.bytecode.data(), blueprint.bytecode.size(),
+                                  blueprint.chunk_name, sol::load_mode::binary);
+            if (!chunk.valid()) {
+                std::cerr << "[" << blueprint.spawn.name << "]: Cant load compiled script"
+                          << std::endl;
+                continue;
+            }
 
-                    break;
-                }
-                case BlockType::Radar: {
-                    always_assert(ship_id != 0 && ship != nullptr, "hub must be placed first");
-                    block_id = m_world.spawn(block, ShipId{.id = ship_id},
-                                             ShipRadar{
-                                                 .dish_handle = ship_radar_dish_texture,
-                                                 .rotation = 0,
-                                                 .rotation_speed = 8.0f * api.time.delta_time,
-                                             },
-                                             Sprite{
-                                                 .handle = ship_radar_base_texture,
-                                             });
-                    break;
-                }
-                case BlockType::Gun: {
-                    always_assert(ship_id != 0 && ship != nullptr, "hub must be placed first");
-                    block_id = m_world.spawn(block, ShipId{.id = ship_id},
-                                             ShipGun{
-                                                 .gun_handle = ship_gun_gun_texture,
-                                                 .rotation = 0,
-                                                 .rotation_speed = 3.0f * api.time.delta_time,
-                                                 .cooldown = 0.8f,
-                                                 .last_shot = api.time.elapsed,
-                                             },
-                                             Sprite{
-                                                 .handle = ship_gun_base_texture,
-                                             });
-                    break;
-                }
-                case BlockType::Hull: {
-                    always_assert(ship_id != 0 && ship != nullptr, "hub must be placed first");
-                    block_id = m_world.spawn(block, ShipId{.id = ship_id},
-                                             Sprite{
-                                                 .handle = ship_hull_texture,
-                                             });
-                    break;
-                }
-                }
+            sol::protected_function script = chunk;
+            sol::protected_function_result result = script();
+            if (!result.valid() || result.get_type() != sol::type::table) {
+                std::cerr << "[" << blueprint.spawn.name << "]: Cant run compiled script"
+                          << std::endl;
+                continue;
+            }
+
+            sol::table table = result;
+            sol::protected_function construct = table["construct"];
+            sol::protected_function update = table["update"];
+            auto block_ids = spawn_ship(api, blueprint.spawn, blueprint.joints, update);
+            m_ships[block_ids.first].run_function = table["run"];
+
+            // block handles made in construct belong to this ship
+            m_current_ship = block_ids.first;
+            m_placement = ShipPlacement{.spawn = &blueprint.spawn, .ids = block_ids};
+
+            auto constructed = construct();
+            const auto complete = !m_placement.diverged && m_placement.placed == block_ids.count;
+            m_placement = ShipPlacement{};
+            m_current_ship = 0;
+
+            if (!constructed.valid()) {
+                sol::error error = constructed;
+                std::cerr << "[" << blueprint.spawn.name << "]: Error: " << error.what()
+                          << std::endl;
+                despawn_ship(block_ids.first);
+                continue;
+            }
+
+            if (!complete) {
+                std::cerr << "[" << blueprint.spawn.name
+                          << "]: construct placed different blocks than when it was loaded"
+                          << std::endl;
+                despawn_ship(block_ids.first);
+                continue;
+            }
+
+            // the ship takes part in this tick, replays spawn it before the same one
+            if (m_recorder.is_open()) {
+                m_recorder.spawn_ship(blueprint.spawn);
+            }
+            if (m_rollback.enabled()) {
+                m_rollback.log(m_step).spawns.push_back(blueprint.spawn);
+            }
+        }
 
-                ship->parts.push_back(block);
+        m_loaded_ships.clear();
+    }
 
-                cpShapeSetFilter(shape, cpShapeFilterNew(ship_id, 0xFFFFFFFF, 0xFFFFFFFF));
+    // removes a ship that never took part in a tick, with its blocks, bodies and script
+    void despawn_ship(EntityId ship_id) {
+        m_world.remove_if<const RigidBody &, const ShipId &>(
+            [this, ship_id](EntityId, const RigidBody &body, const ShipId &ship) {
+                if (ship.id != ship_id)
+                    return false;
 
-                debug_assert(block_id != 0, "block_id must be set");
-                return block_id;
+                destroy_body(body.body);
+                return true;
             });
 
-            construct();
-            m_lua.set_function("place", []() {});
-        };
+        m_ships.erase(ship_id);
+    }
 
-        // api.on_file_dropped("/Users/thekatze/Development/me-when-lua/assets/scripting/script.lua",
-        //                     64.0f, 64.0f);
+    // rebuilds a recorded ship. it never gets a script, replays apply the recorded commands
+    void spawn_recorded_ship(EngineApi &api, const ShipSpawnRecord &spawn) {
+        if (auto error = plan_joints(spawn, m_recorded_joints)) {
+            std::cerr << "[" << spawn.name << "]: Invalid recorded ship: " << *error << std::endl;
+            return;
+        }
+
+        auto block_ids = spawn_ship(api, spawn, m_recorded_joints, sol::protected_function{});
+
+        // a ship spawned again while resimulating after a rewind gets its script back
+        auto fallen = m_fallen_ships.find(block_ids.first);
+        if (fallen != m_fallen_ships.end()) {
+            auto &ship = m_ships[block_ids.first];
+            auto &script = fallen->second.script;
+            ship.update = std::move(script.update);
+            ship.run_function = std::move(script.run_function);
+            ship.run_thread = std::move(script.run_thread);
+            ship.run = std::move(script.run);
+            m_fallen_ships.erase(fallen);
+        }
     }
 
     void update(EngineApi &api) override {
+        PROFILE_SCOPE("ShipSimulationScene::update");
+        const auto update_start = profiler_now_ns();
+        m_timings = TickTimings{};
+
+        if (api.rewind_requested.exchange(false) && m_rollback.enabled()) {
+            rewind(api, std::min<u64>(m_options.rollback.rewind_ticks, m_rollback.max_rewind()));
+        }
+
+        ++m_step;
+        const bool resimulating = m_step <= m_resimulate_until;
+
+        // commands of the last replayed tick must not be applied again once the replay ended
+        m_tick_record.clear();
+
+        if (m_replaying) {
+            m_replay.read_tick(m_step, m_tick_record);
+
+            for (const auto &spawn : m_tick_record.spawns) {
+                spawn_recorded_ship(api, spawn);
+            }
+
+            if (m_tick_record.input) {
+                auto input = *m_tick_record.input;
+                api.up = input & INPUT_UP;
+                api.down = input & INPUT_DOWN;
+                api.left = input & INPUT_LEFT;
+                api.right = input & INPUT_RIGHT;
+            }
+
+            if (m_replay.finished()) {
+                std::cout << "replay finished at step " << m_step << std::endl;
+                m_replaying = false;
+            }
+        } else if (resimulating) {
+            m_tick_record = m_rollback.log(m_step);
+
+            for (const auto &spawn : m_tick_record.spawns) {
+                spawn_recorded_ship(api, spawn);
+            }
+        } else if (m_recorder.is_open()) {
+            m_recorder.begin_tick(m_step);
+            m_recorder.input((api.up ? INPUT_UP : 0) | (api.down ? INPUT_DOWN : 0) |
+                             (api.left ? INPUT_LEFT : 0) | (api.right ? INPUT_RIGHT : 0));
+        }
+
+        if (m_rollback.enabled() && !resimulating) {
+            m_rollback.begin_tick(m_step);
+        }
+
+        if (!m_replaying && !resimulating) {
+            splice_loaded_ships(api);
+        }
 
         const f32 CAMERA_SPEED = 20.0f;
 
+        previous_camera_x = camera_x;
+        previous_camera_y = camera_y;
+
         if (api.up) {
             camera_y -= CAMERA_SPEED;
         }
@@ -314,287 +794,1377 @@ struct ShipSimulationScene : public IScene {
             camera_x += CAMERA_SPEED;
         }
 
-        auto ships_count = m_world.query_count<ShipBrain>();
-
-        std::vector<std::tuple<EntityId, cpVect, f32>> shots_to_spawn{};
-
-        m_world.query<RigidBody &, ShipBrain &>([this, &api, ships_count,
-                                                 &shots_to_spawn](EntityId ship_id, RigidBody &body,
-                                                                  ShipBrain &_) {
-            auto &ship = m_ships[ship_id];
-
-            m_lua.set_function("time", [&api]() { return api.time.elapsed; });
-            m_lua.set_function("ships_count", [ships_count]() { return ships_count; });
-            m_lua.set_function("ship_angle", [body]() { return body.rotation(); });
-            m_lua.set_function("ship_position", [body]() {
-                auto pos = body.position();
-                return std::tuple(pos.x, pos.y);
-            });
-
-            m_lua.set_function("ship_velocity", [body]() {
-                auto vel = body.velocity();
-                return std::tuple(vel.x, vel.y);
-            });
-
-            m_lua.set_function("radar_angle", [this, &ship_id](usize radar_id) {
-                auto components = m_world.get<const ShipId &, const ShipRadar &>(radar_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid radar id\n";
-                    return 0.0f;
-                }
-
-                return std::get<const ShipRadar &>(*components).rotation;
-            });
+        update_spatial_grid();
+        update_ship_lod();
 
-            m_lua.set_function("gun_angle", [this, &ship_id](usize gun_id) {
-                auto components = m_world.get<const ShipId &, const ShipGun &>(gun_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid gun id\n";
-                    return 0.0f;
-                }
+        m_shots_to_spawn.clear();
 
-                return std::get<const ShipGun &>(*components).rotation;
-            });
+        const auto lua_start = profiler_now_ns();
+        const auto lua_memory_before = lua_memory_bytes();
+        if (!m_options.replay_path.empty() || resimulating) {
+            // replays never run lua, the recorded commands stand in for the scripts
+            apply_recorded_commands(api);
+        } else {
+            run_ship_scripts(api);
+        }
+        m_timings.lua_ns = profiler_now_ns() - lua_start;
 
-            m_lua.set_function("radar_rotate", [this, &ship_id](usize radar_id, f32 percentage) {
-                auto components = m_world.get<const ShipId &, ShipRadar &>(radar_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid radar id\n";
-                    return;
-                }
+        m_gc_stats.memory_bytes = lua_memory_bytes();
+        m_gc_stats.update_delta_bytes = static_cast<i64>(m_gc_stats.memory_bytes) -
+                                        static_cast<i64>(lua_memory_before);
+        if (m_gc_stats.update_delta_bytes < 0) {
+            ++m_gc_stats.collections_in_update;
+        }
 
-                percentage = std::clamp(percentage, -100.0f, 100.0f);
+        spawn_projectiles(api, m_shots_to_spawn);
 
-                auto &radar = std::get<ShipRadar &>(*components);
-                if (radar.rotated) {
-                    std::cerr << "already issued a rotation call this frame\n";
-                    return;
-                }
+        update_turrets();
 
-                radar.rotation = radar.rotation + radar.rotation_speed * percentage / 100.0f;
+        const auto sweep_start = profiler_now_ns();
+        sweep_radars();
+        m_timings.physics_ns = profiler_now_ns() - sweep_start;
 
-                radar.rotated = true;
-            });
+        expire_lifetimes(api);
 
-            m_lua.set_function("gun_rotate", [this, &ship_id](usize gun_id, f32 percentage) {
-                auto components = m_world.get<const ShipId &, ShipGun &>(gun_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid gun id\n";
-                    return;
-                }
+        apply_thrusters();
 
-                percentage = std::clamp(percentage, -100.0f, 100.0f);
+        m_world.query<RigidBody &>(
+            [](EntityId id, RigidBody &body) { body.store_previous_state(); });
 
-                auto &gun = std::get<ShipGun &>(*components);
-                if (gun.rotated) {
-                    std::cerr << "already issued a rotation call this frame\n";
-                    return;
-                }
+        m_contacts.clear();
 
-                gun.rotation = gun.rotation + gun.rotation_speed * percentage / 100.0f;
+        const auto step_start = profiler_now_ns();
+        {
+            PROFILE_SCOPE("physics step");
+            cpSpaceStep(m_space, api.time.delta_time);
+        }
+        // contacts and the stream below count as ecs work, checkpoints are timed on their own
+        m_timings.physics_ns += profiler_now_ns() - step_start;
 
-                gun.rotated = true;
-            });
+        process_contacts(api);
 
-            m_lua.set_function("radar_ping", [this, &body, &ship_id, &api](usize radar_id) {
-                auto components =
-                    m_world.get<const ShipId &, const RigidBody &, const ShipRadar &>(radar_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid radar id\n";
-                    return -1.0f;
-                }
+        if (m_step % WORLD_COMPACT_INTERVAL == 0) {
+            PROFILE_SCOPE("world compact");
+            m_world.compact();
+        }
 
-                auto &radar_body = std::get<const RigidBody &>(*components);
-                auto &radar = std::get<const ShipRadar &>(*components);
+        export_state(api);
 
-                auto total_rotation = body.rotation() + radar.rotation;
-                auto origin = radar_body.position();
-                auto target = origin + cpvmult(cpvforangle(total_rotation), 2000);
+        const auto checkpoint_start = profiler_now_ns();
+        save_checkpoint(api);
+        m_timings.checkpoint_ns = profiler_now_ns() - checkpoint_start;
 
-                cpSegmentQueryInfo result;
-                if (!cpSpaceSegmentQueryFirst(m_space, origin, target, 10.0f,
-                                              cpShapeFilterNew(ship_id, 0xFFFFFFFF, 0xFFFFFFFF),
-                                              &result)) {
-                    return 0.0f;
-                }
+        m_timings.total_ns = profiler_now_ns() - update_start;
+    }
 
-                return static_cast<f32>(cpvlength(cpvsub(result.point, origin)));
-            });
+    // the ship api is registered once, the functions act on the ship whose script is running
+    void register_ship_api(EngineApi &api) {
+        m_lua.set_function("time", [&api]() { return api.time.elapsed; });
+        m_lua.set_function("delta_time", [this]() { return m_current_dt; });
 
-            m_lua.set_function("gun_cooled_down", [this, &ship_id, &api](usize gun_id) {
-                auto components = m_world.get<const ShipId &, const ShipGun &>(gun_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid gun id\n";
-                    return false;
-                }
+        // seconds the run coroutine may still take this tick, 0 once it is over its budget
+        m_lua.set_function("budget_left", [this]() {
+            auto now = profiler_now_ns();
+            return now < m_coroutine_deadline ? (m_coroutine_deadline - now) / 1e9 : 0.0;
+        });
+        m_lua.set_function("run_time", [this]() { return m_current_run_ns / 1e9; });
+        m_lua.script(R"(
+            function yield_if_over_budget()
+                if coroutine.running() and budget_left() <= 0 then
+                    coroutine.yield()
+                end
+            end
+        )");
+        m_lua.set_function("ships_count", [this]() { return m_ships_count; });
+
+        // only does something while splice_loaded_ships runs construct
+        m_lua.set_function("place", [this](BlockType type, i32 dx, i32 dy) -> EntityId {
+            auto &placement = m_placement;
+            if (!placement.spawn)
+                return 0;
+
+            const auto &blocks = placement.spawn->blocks;
+            const auto index = placement.placed;
+            if (placement.diverged || index >= blocks.size() ||
+                blocks[index].type != static_cast<u8>(type) || blocks[index].dx != dx ||
+                blocks[index].dy != dy) {
+                placement.diverged = true;
+                return 0;
+            }
 
-                auto &gun = std::get<const ShipGun &>(*components);
-                return !(gun.last_shot + gun.cooldown >= api.time.elapsed);
-            });
+            ++placement.placed;
+            return placement.ids[index];
+        });
+        m_lua.set_function("ship_angle", [this]() { return m_current_body.rotation(); });
+        m_lua.set_function("ship_position", [this]() {
+            auto pos = m_current_body.position();
+            return std::tuple(pos.x, pos.y);
+        });
 
-            m_lua.set_function("gun_shoot", [this, &ship_id, &api, &shots_to_spawn](usize gun_id) {
-                auto components = m_world.get<const ShipId &, const RigidBody &, ShipGun &>(gun_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid gun id\n";
-                    return;
-                }
+        m_lua.set_function("ship_velocity", [this]() {
+            auto vel = m_current_body.velocity();
+            return std::tuple(vel.x, vel.y);
+        });
 
-                auto &gun_body = std::get<const RigidBody &>(*components);
-                auto &gun = std::get<ShipGun &>(*components);
+        m_lua.set_function("nearby_ships", [this](f64 radius) {
+            return spatial_to_table(m_current_body.position(), radius, SpatialKind::Ship,
+                                    m_current_ship);
+        });
 
-                if (gun.last_shot + gun.cooldown >= api.time.elapsed) {
-                    std::cerr << "tried shooting while on cooldown\n";
-                    return;
-                }
+        m_lua.set_function("nearby_projectiles", [this](f64 radius) {
+            return spatial_to_table(m_current_body.position(), radius, SpatialKind::Projectile,
+                                    m_current_ship);
+        });
 
-                gun.last_shot = api.time.elapsed;
+        m_lua.set_function("nearest_ships", [this](usize count) {
+            auto center = m_current_body.position();
+            auto ship_id = m_current_ship;
+            m_spatial.query_nearest(
+                center, count, RADAR_RANGE,
+                [ship_id](const SpatialEntry &entry) {
+                    return entry.kind == SpatialKind::Ship && entry.owner != ship_id;
+                },
+                m_nearest_scratch);
+
+            auto result = m_lua.create_table(m_nearest_scratch.size(), 0);
+            for (usize i = 0; i < m_nearest_scratch.size(); ++i) {
+                result[i + 1] = entry_to_table(m_nearest_scratch[i], center);
+            }
 
-                auto total_rotation = gun_body.rotation() + gun.rotation;
+            return result;
+        });
 
-                shots_to_spawn.emplace_back(ship_id, gun_body.position(), total_rotation);
-            });
+        m_lua.set_function("radar_angle", [this](usize radar_id) {
+            auto components = m_world.get<const ShipId &, const ShipRadar &>(radar_id);
+            if (!components || std::get<const ShipId &>(*components).id != m_current_ship) {
+                std::cerr << "invalid radar id\n";
+                return 0.0f;
+            }
 
-            m_lua.set_function("thruster_set", [this, &ship_id](usize thruster_id, f32 percentage) {
-                auto components =
-                    m_world.get<const ShipId &, const RigidBody &, const ShipThruster &>(
-                        thruster_id);
-                if (!components || std::get<const ShipId &>(*components).id != ship_id) {
-                    std::cerr << "invalid thruster id\n";
-                    return;
-                }
+            return std::get<const ShipRadar &>(*components).rotation;
+        });
 
-                auto &rigid_body = std::get<const RigidBody &>(*components);
-                auto &thruster = std::get<const ShipThruster &>(*components);
+        m_lua.set_function("gun_angle", [this](usize gun_id) {
+            auto components = m_world.get<const ShipId &, const ShipGun &>(gun_id);
+            if (!components || std::get<const ShipId &>(*components).id != m_current_ship) {
+                std::cerr << "invalid gun id\n";
+                return 0.0f;
+            }
 
-                auto thrust = std::clamp(percentage, 0.0f, 100.0f);
-                auto dir = rigid_body.direction();
-                cpBodyApplyForceAtLocalPoint(rigid_body.body,
-                                             cpvmult(dir, thrust * thruster.max_thrust), cpvzero);
-            });
+            return std::get<const ShipGun &>(*components).rotation;
+        });
 
-            sol::protected_function_result update_result = ship.update();
-            if (!update_result.valid()) {
-                sol::error error = update_result;
-                std::cerr << "[" << ship.name << "]: Error: " << error.what() << std::endl;
+        m_lua.set_function("radar_rotate", [this](usize radar_id, f32 percentage) {
+            if (apply_radar_rotate(m_current_ship, radar_id, percentage)) {
+                record_command(RecordType::RadarRotate, m_current_ship, radar_id, percentage);
             }
         });
 
-        auto gun_shot_texture = api.assets.textures.get(m_gun_shot_texture);
-        f32 w, h;
-        SDL_GetTextureSize(gun_shot_texture, &w, &h);
-
-        for (auto &shot : shots_to_spawn) {
-            auto ship_id = std::get<EntityId>(shot);
-            auto origin = std::get<cpVect>(shot);
-            auto angle = std::get<f32>(shot);
-
-            auto mass = 100000.0f;
-            auto moment = cpMomentForBox(mass, w, h);
+        m_lua.set_function("gun_rotate", [this](usize gun_id, f32 percentage) {
+            if (apply_gun_rotate(m_current_ship, gun_id, percentage)) {
+                record_command(RecordType::GunRotate, m_current_ship, gun_id, percentage);
+            }
+        });
 
-            RigidBody block{.body = cpSpaceAddBody(m_space, cpBodyNew(mass, moment)),
-                            .relative_position = cpvzero};
-            auto shape = cpSpaceAddShape(m_space, cpBoxShapeNew(block.body, w, h, 0));
-            cpShapeSetFilter(shape, cpShapeFilterNew(ship_id, 0xFFFFFFFF, 0xFFFFFFFF));
+        m_lua.set_function("radar_aim", [this](usize radar_id, f32 rotation) {
+            if (apply_radar_aim(m_current_ship, radar_id, rotation)) {
+                record_command(RecordType::RadarAim, m_current_ship, radar_id, rotation);
+            }
+        });
 
-            cpBodySetPosition(block.body, origin);
-            cpBodySetAngle(block.body, angle);
+        m_lua.set_function("gun_aim", [this](usize gun_id, f32 rotation) {
+            if (apply_gun_aim(m_current_ship, gun_id, rotation)) {
+                record_command(RecordType::GunAim, m_current_ship, gun_id, rotation);
+            }
+        });
 
-            const f32 BULLET_SPEED = 1000.0;
-            cpBodySetVelocity(block.body, cpvforangle(angle) * BULLET_SPEED);
+        m_lua.set_function("radar_ping", [this](usize radar_id) {
+            auto components = m_world.get<const ShipId &, const ShipRadar &>(radar_id);
+            if (!components || std::get<const ShipId &>(*components).id != m_current_ship) {
+                std::cerr << "invalid radar id\n";
+                return -1.0f;
+            }
 
-            m_world.spawn(block, Sprite{.handle = m_gun_shot_texture},
-                          Lifetime{.until = api.time.elapsed + 1.0f});
-        }
+            return std::get<const ShipRadar &>(*components).ping_distance;
+        });
 
-        m_world.query<ShipRadar &>([](EntityId &id, ShipRadar &radar) { radar.rotated = false; });
-        m_world.query<ShipGun &>([](EntityId &id, ShipGun &gun) { gun.rotated = false; });
+        m_lua.set_function("gun_cooled_down", [this, &api](usize gun_id) {
+            auto components = m_world.get<const ShipId &, const ShipGun &>(gun_id);
+            if (!components || std::get<const ShipId &>(*components).id != m_current_ship) {
+                std::cerr << "invalid gun id\n";
+                return false;
+            }
 
-        std::vector<EntityId> to_remove{};
+            auto &gun = std::get<const ShipGun &>(*components);
+            return !(gun.last_shot + gun.cooldown >= api.time.elapsed);
+        });
 
-        m_world.query<const Lifetime &>([&api, &to_remove](EntityId id, const Lifetime &lifetime) {
-            if (lifetime.until <= api.time.elapsed) {
-                to_remove.emplace_back(id);
+        m_lua.set_function("gun_shoot", [this, &api](usize gun_id) {
+            if (apply_gun_shoot(api, m_current_ship, gun_id)) {
+                record_command(RecordType::GunShoot, m_current_ship, gun_id, 0.0f);
             }
         });
 
-        for (auto id : to_remove) {
-            auto rigid_body = m_world.get<RigidBody &>(id);
-            if (rigid_body) {
-                auto body = std::get<RigidBody &>(*rigid_body);
-                cpSpaceRemoveBody(m_space, body.body);
+        m_lua.set_function("thruster_set", [this](usize thruster_id, f32 percentage) {
+            if (apply_thrust(m_current_ship, thruster_id, percentage)) {
+                record_command(RecordType::Thrust, m_current_ship, thruster_id, percentage);
             }
+        });
 
-            m_world.remove<Lifetime>(id);
-        }
-
-        cpSpaceStep(m_space, api.time.delta_time);
+        register_block_handles(api);
     }
 
-    void render(EngineApi &api) override {
-        m_world.query<const RigidBody &, const Sprite &>(
-            [&api, this](EntityId id, const RigidBody &body, const Sprite &sprite) {
-                auto texture = api.assets.textures.get(sprite.handle);
-                auto pos = body.position();
-                f32 w, h;
-                SDL_GetTextureSize(texture, &w, &h);
-
-                SDL_FRect dest{
-                    .x = static_cast<f32>(pos.x - camera_x) - w / 2.0f,
-                    .y = static_cast<f32>(pos.y - camera_y) - h / 2.0f,
-                    .w = w,
-                    .h = h,
-                };
-
-                SDL_FPoint center{.x = w / 2, .y = h / 2};
-
-                SDL_RenderTextureRotated(api.renderer, texture, NULL, &dest,
-                                         body.rotation() * RAD2DEG, &center, SDL_FLIP_NONE);
+    // optional typed api next to the id based functions, gun_handle(id) returns a Gun that
+    // supports gun.angle, gun:rotate(50) and so on. commands are validated and recorded the same
+    void register_block_handles(EngineApi &api) {
+        using GunHandle = BlockHandle<ShipGun>;
+        using RadarHandle = BlockHandle<ShipRadar>;
+        using ThrusterHandle = BlockHandle<ShipThruster>;
+
+        m_lua.set_function("gun_handle", [this](EntityId id) {
+            return make_block_handle<ShipGun>(id, "gun");
+        });
+        m_lua.set_function("radar_handle", [this](EntityId id) {
+            return make_block_handle<ShipRadar>(id, "radar");
+        });
+        m_lua.set_function("thruster_handle", [this](EntityId id) {
+            return make_block_handle<ShipThruster>(id, "thruster");
+        });
+
+        m_lua.new_usertype<GunHandle>(
+            "Gun", sol::no_constructor, "id",
+            sol::readonly_property([](const GunHandle &gun) { return gun.ref.id; }), "angle",
+            sol::readonly_property([this](GunHandle &gun) {
+                auto actuator = resolve_block_handle(gun, "gun");
+                return actuator ? actuator->rotation : 0.0f;
+            }),
+            "rotate",
+            [this](GunHandle &gun, f32 percentage) {
+                auto actuator = resolve_block_handle(gun, "gun");
+                if (actuator && set_turn(*actuator, percentage)) {
+                    record_command(RecordType::GunRotate, m_current_ship, gun.ref.id, percentage);
+                }
+            },
+            "aim",
+            [this](GunHandle &gun, f32 rotation) {
+                auto actuator = resolve_block_handle(gun, "gun");
+                if (actuator && set_aim(*actuator, rotation)) {
+                    record_command(RecordType::GunAim, m_current_ship, gun.ref.id, rotation);
+                }
+            },
+            "cooled_down",
+            [this, &api](GunHandle &gun) {
+                auto actuator = resolve_block_handle(gun, "gun");
+                return actuator && !(actuator->last_shot + actuator->cooldown >= api.time.elapsed);
+            },
+            "shoot",
+            [this, &api](GunHandle &gun) {
+                auto actuator = resolve_block_handle(gun, "gun");
+                if (actuator &&
+                    fire_gun(api, m_current_ship, gun.ref.get<const RigidBody>(), *actuator)) {
+                    record_command(RecordType::GunShoot, m_current_ship, gun.ref.id, 0.0f);
+                }
             });
 
-        m_world.query<const RigidBody &, const ShipRadar &>(
-            [&api, this](EntityId id, const RigidBody &body, const ShipRadar &radar) {
-                auto texture = api.assets.textures.get(radar.dish_handle);
-                auto pos = body.position();
+        m_lua.new_usertype<RadarHandle>(
+            "Radar", sol::no_constructor, "id",
+            sol::readonly_property([](const RadarHandle &radar) { return radar.ref.id; }),
+            "angle",
+            sol::readonly_property([this](RadarHandle &radar) {
+                auto actuator = resolve_block_handle(radar, "radar");
+                return actuator ? actuator->rotation : 0.0f;
+            }),
+            "rotate",
+            [this](RadarHandle &radar, f32 percentage) {
+                auto actuator = resolve_block_handle(radar, "radar");
+                if (actuator && set_turn(*actuator, percentage)) {
+                    record_command(RecordType::RadarRotate, m_current_ship, radar.ref.id,
+                                   percentage);
+                }
+            },
+            "aim",
+            [this](RadarHandle &radar, f32 rotation) {
+                auto actuator = resolve_block_handle(radar, "radar");
+                if (actuator && set_aim(*actuator, rotation)) {
+                    record_command(RecordType::RadarAim, m_current_ship, radar.ref.id, rotation);
+                }
+            },
+            "ping",
+            [this](RadarHandle &radar) {
+                auto actuator = resolve_block_handle(radar, "radar");
+                return actuator ? actuator->ping_distance : -1.0f;
+            });
 
-                f32 w, h;
-                SDL_GetTextureSize(texture, &w, &h);
+        m_lua.new_usertype<ThrusterHandle>(
+            "Thruster", sol::no_constructor, "id",
+            sol::readonly_property([](const ThrusterHandle &thruster) { return thruster.ref.id; }),
+            "throttle",
+            sol::readonly_property([this](ThrusterHandle &thruster) {
+                auto actuator = resolve_block_handle(thruster, "thruster");
+                return actuator ? actuator->throttle : 0.0f;
+            }),
+            "set", [this](ThrusterHandle &thruster, f32 percentage) {
+                auto actuator = resolve_block_handle(thruster, "thruster");
+                if (actuator && set_throttle(*actuator, percentage)) {
+                    record_command(RecordType::Thrust, m_current_ship, thruster.ref.id,
+                                   percentage);
+                }
+            });
+    }
 
-                auto total_rotation = body.rotation() + radar.rotation;
+    // nil for ids that are not an actuator of this kind on the current ship
+    template <class Actuator>
+    sol::optional<BlockHandle<Actuator>> make_block_handle(EntityId id, const char *kind) {
+        BlockHandle<Actuator> handle{.ref = {.id = id}};
+        if (!m_world.refresh(handle.ref) ||
+            handle.ref.template get<const ShipId>().id != m_current_ship) {
+            std::cerr << "invalid " << kind << " id\n";
+            return sol::nullopt;
+        }
 
-                SDL_FRect dest{
-                    .x = static_cast<f32>(pos.x - camera_x) - w / 2.0f,
-                    .y = static_cast<f32>(pos.y - camera_y) - h / 2.0f,
-                    .w = w,
-                    .h = h,
-                };
+        return handle;
+    }
 
-                SDL_FPoint center{.x = w / 2, .y = h / 2};
+    // the actuator behind a handle. the lookup only runs again after the rows of its archetype
+    // moved, which happens when blocks of that kind are destroyed or the archetype grows
+    template <class Actuator>
+    Actuator *resolve_block_handle(BlockHandle<Actuator> &handle, const char *kind) {
+        auto &ref = handle.ref;
+        if ((!ref.valid() && !m_world.refresh(ref)) ||
+            ref.template get<const ShipId>().id != m_current_ship) {
+            std::cerr << "invalid " << kind << " handle\n";
+            return nullptr;
+        }
 
-                SDL_RenderTextureRotated(api.renderer, texture, NULL, &dest,
-                                         total_rotation * RAD2DEG, &center, SDL_FLIP_NONE);
-            });
+        return &ref.template get<Actuator>();
+    }
 
-        m_world.query<const RigidBody &, const ShipGun &>(
-            [&api, this](EntityId id, const RigidBody &body, const ShipGun &gun) {
-                auto texture = api.assets.textures.get(gun.gun_handle);
-                auto pos = body.position();
+    u64 lua_memory_bytes() {
+        auto *state = m_lua.lua_state();
+        return static_cast<u64>(lua_gc(state, LUA_GCCOUNT, 0)) * 1024 +
+               static_cast<u64>(lua_gc(state, LUA_GCCOUNTB, 0));
+    }
 
-                f32 w, h;
-                SDL_GetTextureSize(texture, &w, &h);
+    // steps the collector while the simulation waits for the next tick. a cycle is started once
+    // the heap is halfway to where the automatic collector would kick in, so it rarely gets to
+    // run in the middle of a ship script.
+    void idle(EngineApi &api, u64 available_ns) override {
+        m_gc_stats.idle_ns = 0;
+        m_gc_stats.idle_steps = 0;
 
-                auto total_rotation = body.rotation() + gun.rotation;
+        if (available_ns <= m_options.gc.idle_reserve_ns)
+            return;
 
-                SDL_FRect dest{
-                    .x = static_cast<f32>(pos.x - camera_x) - w / 2.0f,
-                    .y = static_cast<f32>(pos.y - camera_y) - h / 2.0f,
-                    .w = w,
-                    .h = h,
-                };
+        if (!m_gc_cycle_running) {
+            auto pause_percent = static_cast<u64>(std::max(m_options.gc.pause - 100, 0));
+            auto growth_until_automatic = m_gc_baseline_bytes * pause_percent / 100;
+            if (lua_memory_bytes() < m_gc_baseline_bytes + growth_until_automatic / 2)
+                return;
 
-                SDL_FPoint center{.x = w / 2, .y = h / 2};
+            m_gc_cycle_running = true;
+        }
 
-                SDL_RenderTextureRotated(api.renderer, texture, NULL, &dest,
-                                         total_rotation * RAD2DEG, &center, SDL_FLIP_NONE);
+        PROFILE_SCOPE("lua gc idle");
+        const auto start = profiler_now_ns();
+        const auto deadline = start + available_ns - m_options.gc.idle_reserve_ns;
+
+        auto now = start;
+        while (now < deadline) {
+            ++m_gc_stats.idle_steps;
+            auto cycle_finished =
+                lua_gc(m_lua.lua_state(), LUA_GCSTEP, m_options.gc.idle_step_kb) == 1;
+            now = profiler_now_ns();
+
+            if (cycle_finished) {
+                m_gc_cycle_running = false;
+                m_gc_baseline_bytes = lua_memory_bytes();
+                break;
+            }
+        }
+
+        m_gc_stats.idle_ns = now - start;
+    }
+
+    // decides how much simulation every ship gets. the checks are spread over check_interval
+    // ticks, in between a ship keeps its level
+    void update_ship_lod() {
+        PROFILE_SCOPE("ship lod");
+        const auto &settings = m_options.lod;
+        m_lod_stats = LodStats{};
+
+        m_world.query<const RigidBody &, ShipBrain &>(
+            [&](EntityId ship_id, const RigidBody &hub, ShipBrain &brain) {
+                // something bumped into the ship and chipmunk woke it up
+                if (brain.lod == ShipLod::Asleep && !cpBodyIsSleeping(hub.body)) {
+                    brain.lod = ShipLod::Full;
+                    brain.isolated_checks = 0;
+                }
+
+                // chipmunk puts ships to sleep on its own once they are perfectly still, like
+                // right after spawning. only the lod decides when a ship sleeps, otherwise its
+                // thrusters and radars would stop until something bumps into it
+                if (brain.lod != ShipLod::Asleep && cpBodyIsSleeping(hub.body)) {
+                    cpBodyActivate(hub.body);
+                }
+
+                const auto interval = std::max<u32>(settings.check_interval, 1);
+                if (settings.enabled && (m_step + ship_id) % interval == 0) {
+                    check_ship_lod(ship_id, hub, brain);
+                }
+
+                switch (brain.lod) {
+                case ShipLod::Full:
+                    ++m_lod_stats.full;
+                    break;
+                case ShipLod::Reduced:
+                    ++m_lod_stats.reduced;
+                    break;
+                case ShipLod::Asleep:
+                    ++m_lod_stats.asleep;
+                    break;
+                }
+            });
+    }
+
+    void check_ship_lod(EntityId ship_id, const RigidBody &hub, ShipBrain &brain) {
+        const auto &settings = m_options.lod;
+
+        bool isolated = true;
+        m_spatial.query_radius(hub.position(), settings.radius, [&](const SpatialEntry &entry) {
+            isolated = isolated && entry.owner == ship_id;
+        });
+
+        if (!isolated) {
+            // waking the hub wakes every body joined to it
+            if (brain.lod == ShipLod::Asleep) {
+                cpBodyActivate(hub.body);
+            }
+
+            brain.lod = ShipLod::Full;
+            brain.isolated_checks = 0;
+            return;
+        }
+
+        ++brain.isolated_checks;
+
+        if (brain.lod == ShipLod::Full) {
+            brain.lod = ShipLod::Reduced;
+            // spreads the scripts of isolated ships over the interval
+            brain.skipped_ticks = ship_id % std::max<u32>(settings.script_interval, 1);
+        }
+
+        const bool slow = cpvlength(hub.velocity()) < settings.sleep_speed &&
+                          std::abs(cpBodyGetAngularVelocity(hub.body)) < 0.1;
+
+        if (brain.lod == ShipLod::Reduced && settings.sleep_after_checks > 0 &&
+            brain.isolated_checks >= settings.sleep_after_checks && slow) {
+            cpBodySleep(hub.body);
+            brain.lod = ShipLod::Asleep;
+        }
+    }
+
+    void run_ship_scripts(EngineApi &api) {
+        m_ships_count = m_world.query_count<ShipBrain>();
+        m_coroutine_stats = CoroutineStats{};
+
+        m_world.query<RigidBody &, ShipBrain &>(
+            [this, &api](EntityId ship_id, RigidBody &body, ShipBrain &brain) {
+                // a sleeping ship did not move, after waking up its script continues from the
+                // tick it woke up in instead of seeing the whole time it slept
+                if (brain.lod == ShipLod::Asleep) {
+                    brain.accumulated_dt = 0.0f;
+                    return;
+                }
+
+                brain.accumulated_dt += api.time.delta_time;
+
+                if (brain.lod == ShipLod::Reduced &&
+                    ++brain.skipped_ticks < m_options.lod.script_interval)
+                    return;
+
+                brain.skipped_ticks = 0;
+                m_current_dt = brain.accumulated_dt;
+                brain.accumulated_dt = 0.0f;
+
+                PROFILE_SCOPE("ship script");
+                auto &ship = m_ships[ship_id];
+
+                m_current_ship = ship_id;
+                m_current_body = body;
+                m_current_run_ns = ship.run_ns;
+
+                // ships rebuilt without a script only follow replayed commands
+                if (ship.update.valid()) {
+                    sol::protected_function_result update_result = ship.update();
+                    if (!update_result.valid()) {
+                        sol::error error = update_result;
+                        std::cerr << "[" << ship.name << "]: Error: " << error.what()
+                                  << std::endl;
+                    }
+                }
+
+                if (ship.run_function.valid()) {
+                    resume_coroutine(ship);
+                }
+            });
+
+        m_current_ship = 0;
+    }
+
+    // the coroutine runs until it yields, the budget is only enforced by the script calling
+    // yield_if_over_budget. actuators keep their settings while a plan takes several ticks
+    void resume_coroutine(ShipScript &ship) {
+        PROFILE_SCOPE("ship coroutine");
+
+        if (!ship.run.valid() || !ship.run.runnable()) {
+            ship.run_thread = sol::thread::create(m_lua.lua_state());
+            ship.run = sol::coroutine(ship.run_thread.state(),
+                                      sol::ref_index(ship.run_function.registry_index()));
+        }
+
+        const auto start = profiler_now_ns();
+        m_coroutine_deadline = start + m_options.coroutine_budget_ns;
+
+        sol::protected_function_result result = ship.run();
+
+        ship.run_ns = profiler_now_ns() - start;
+        m_coroutine_deadline = 0;
+
+        ++m_coroutine_stats.resumed;
+        m_coroutine_stats.total_ns += ship.run_ns;
+        m_coroutine_stats.max_ns = std::max(m_coroutine_stats.max_ns, ship.run_ns);
+
+        if (!result.valid()) {
+            sol::error error = result;
+            std::cerr << "[" << ship.name << "]: Error in run: " << error.what() << std::endl;
+
+            // a broken coroutine would fail again on every tick
+            ship.run_function = sol::protected_function{};
+            ship.run = sol::coroutine{};
+            ship.run_thread = sol::thread{};
+        }
+    }
+
+    void apply_recorded_commands(EngineApi &api) {
+        PROFILE_SCOPE("replay commands");
+
+        for (const auto &command : m_tick_record.commands) {
+            switch (command.type) {
+            case RecordType::Thrust:
+                apply_thrust(command.ship_id, command.block_id, command.value);
+                break;
+            case RecordType::RadarRotate:
+                apply_radar_rotate(command.ship_id, command.block_id, command.value);
+                break;
+            case RecordType::GunRotate:
+                apply_gun_rotate(command.ship_id, command.block_id, command.value);
+                break;
+            case RecordType::RadarAim:
+                apply_radar_aim(command.ship_id, command.block_id, command.value);
+                break;
+            case RecordType::GunAim:
+                apply_gun_aim(command.ship_id, command.block_id, command.value);
+                break;
+            case RecordType::GunShoot:
+                apply_gun_shoot(api, command.ship_id, command.block_id);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void record_command(RecordType type, EntityId ship_id, EntityId block_id, f32 value) {
+        const ShipCommand command{
+            .type = type, .ship_id = ship_id, .block_id = block_id, .value = value};
+
+        if (m_recorder.is_open()) {
+            m_recorder.command(command);
+        }
+        if (m_rollback.enabled()) {
+            m_rollback.log(m_step).commands.push_back(command);
+        }
+    }
+
+    // ship commands are validated here for both lua calls and replays. actuator commands only
+    // store the new setting and return whether it changed, only changes get recorded
+    template <class Actuator>
+    Actuator *find_actuator(EntityId ship_id, EntityId id, const char *kind) {
+        auto components = m_world.get<const ShipId &, Actuator &>(id);
+        if (!components || std::get<const ShipId &>(*components).id != ship_id) {
+            std::cerr << "invalid " << kind << " id\n";
+            return nullptr;
+        }
+
+        return &std::get<Actuator &>(*components);
+    }
+
+    template <class Turret> static bool set_turn(Turret &turret, f32 percentage) {
+        percentage = std::clamp(percentage, -100.0f, 100.0f);
+        if (!turret.aiming && turret.turn == percentage)
+            return false;
+
+        turret.aiming = false;
+        turret.turn = percentage;
+        return true;
+    }
+
+    template <class Turret> static bool set_aim(Turret &turret, f32 rotation) {
+        if (turret.aiming && turret.target_rotation == rotation)
+            return false;
+
+        turret.aiming = true;
+        turret.target_rotation = rotation;
+        return true;
+    }
+
+    bool apply_radar_rotate(EntityId ship_id, EntityId radar_id, f32 percentage) {
+        auto radar = find_actuator<ShipRadar>(ship_id, radar_id, "radar");
+        return radar && set_turn(*radar, percentage);
+    }
+
+    bool apply_gun_rotate(EntityId ship_id, EntityId gun_id, f32 percentage) {
+        auto gun = find_actuator<ShipGun>(ship_id, gun_id, "gun");
+        return gun && set_turn(*gun, percentage);
+    }
+
+    bool apply_radar_aim(EntityId ship_id, EntityId radar_id, f32 rotation) {
+        auto radar = find_actuator<ShipRadar>(ship_id, radar_id, "radar");
+        return radar && set_aim(*radar, rotation);
+    }
+
+    bool apply_gun_aim(EntityId ship_id, EntityId gun_id, f32 rotation) {
+        auto gun = find_actuator<ShipGun>(ship_id, gun_id, "gun");
+        return gun && set_aim(*gun, rotation);
+    }
+
+    bool apply_gun_shoot(EngineApi &api, EntityId ship_id, EntityId gun_id) {
+        auto components = m_world.get<const ShipId &, const RigidBody &, ShipGun &>(gun_id);
+        if (!components || std::get<const ShipId &>(*components).id != ship_id) {
+            std::cerr << "invalid gun id\n";
+            return false;
+        }
+
+        return fire_gun(api, ship_id, std::get<const RigidBody &>(*components),
+                        std::get<ShipGun &>(*components));
+    }
+
+    bool fire_gun(EngineApi &api, EntityId ship_id, const RigidBody &gun_body, ShipGun &gun) {
+        if (gun.last_shot + gun.cooldown >= api.time.elapsed) {
+            std::cerr << "tried shooting while on cooldown\n";
+            return false;
+        }
+
+        gun.last_shot = api.time.elapsed;
+
+        auto total_rotation = gun_body.rotation() + gun.rotation;
+
+        m_shots_to_spawn.emplace_back(ship_id, gun_body.position(), total_rotation);
+        return true;
+    }
+
+    bool apply_thrust(EntityId ship_id, EntityId thruster_id, f32 percentage) {
+        auto thruster = find_actuator<ShipThruster>(ship_id, thruster_id, "thruster");
+        return thruster && set_throttle(*thruster, percentage);
+    }
+
+    static bool set_throttle(ShipThruster &thruster, f32 percentage) {
+        auto throttle = std::clamp(percentage, 0.0f, 100.0f);
+        if (thruster.throttle == throttle)
+            return false;
+
+        thruster.throttle = throttle;
+        return true;
+    }
+
+    // native actuator systems, one pass over each actuator column per tick
+    void update_turrets() {
+        PROFILE_SCOPE("turrets");
+        m_world.query<ShipRadar &>([](EntityId id, ShipRadar &radar) { step_turret(radar); });
+        m_world.query<ShipGun &>([](EntityId id, ShipGun &gun) { step_turret(gun); });
+    }
+
+    void apply_thrusters() {
+        PROFILE_SCOPE("thrusters");
+        m_world.query<const RigidBody &, const ShipThruster &>(
+            [](EntityId id, const RigidBody &body, const ShipThruster &thruster) {
+                // update_ship_lod woke every ship that is not asleep in the lod, the ones still
+                // sleeping stay where they are. applying a force would wake them
+                if (thruster.throttle <= 0.0f || cpBodyIsSleeping(body.body))
+                    return;
+
+                cpBodyApplyForceAtLocalPoint(
+                    body.body, cpvmult(body.direction(), thruster.throttle * thruster.max_thrust),
+                    cpvzero);
+            });
+    }
+
+    void spawn_projectiles(EngineApi &api,
+                           const std::vector<std::tuple<EntityId, cpVect, f32>> &shots) {
+        PROFILE_SCOPE("spawn projectiles");
+
+        const auto w = PROJECTILE_DIMENSIONS.x;
+        const auto h = PROJECTILE_DIMENSIONS.y;
+
+        m_world.spawn_batch_in(m_archetypes.projectile, shots.size(), [&](usize i, EntityId id) {
+            auto ship_id = std::get<EntityId>(shots[i]);
+            auto origin = std::get<cpVect>(shots[i]);
+            auto angle = std::get<f32>(shots[i]);
+
+            auto mass = 100000.0f;
+            auto moment = cpMomentForBox(mass, w, h);
+
+            RigidBody block{.body = cpSpaceAddBody(m_space, m_physics.body(mass, moment)),
+                            .relative_position = cpvzero};
+            auto shape = block.shape = cpSpaceAddShape(m_space, m_physics.box(block.body, w, h));
+            block.size = PROJECTILE_DIMENSIONS;
+            cpShapeSetFilter(shape, cpShapeFilterNew(ship_id, 0xFFFFFFFF, 0xFFFFFFFF));
+            cpShapeSetCollisionType(shape, COLLISION_PROJECTILE);
+            cpBodySetUserData(block.body, reinterpret_cast<cpDataPointer>(id));
+
+            cpBodySetPosition(block.body, origin);
+            cpBodySetAngle(block.body, angle);
+            block.store_previous_state();
+
+            const f32 BULLET_SPEED = 1000.0;
+            cpBodySetVelocity(block.body, cpvforangle(angle) * BULLET_SPEED);
+
+            return std::tuple(block, Sprite{.handle = m_gun_shot_texture},
+                              Lifetime{.until = api.time.elapsed + 1.0f},
+                              Projectile{.ship_id = ship_id});
+        });
+    }
+
+    // lifetime system: everything past its lifetime is despawned with one compacting pass per
+    // archetype, so a whole volley expiring at once stays linear
+    void expire_lifetimes(EngineApi &api) {
+        PROFILE_SCOPE("expire lifetimes");
+        const auto now = api.time.elapsed;
+
+        m_world.remove_if<const Lifetime &, const RigidBody &>(
+            [this, now](EntityId id, const Lifetime &lifetime, const RigidBody &body) {
+                if (lifetime.until > now)
+                    return false;
+
+                destroy_body(body.body);
+                return true;
+            });
+    }
+
+    static void record_contact(cpArbiter *arbiter, cpSpace *space, cpDataPointer data) {
+        // only the first step of a touch counts as a hit, the projectile is gone after it
+        if (!cpArbiterIsFirstContact(arbiter))
+            return;
+
+        CP_ARBITER_GET_BODIES(arbiter, projectile, block);
+
+        auto scene = static_cast<ShipSimulationScene *>(data);
+        scene->m_contacts.push_back(ContactRecord{
+            .projectile = reinterpret_cast<EntityId>(cpBodyGetUserData(projectile)),
+            .block = reinterpret_cast<EntityId>(cpBodyGetUserData(block)),
+            .impulse = static_cast<f32>(cpvlength(cpArbiterTotalImpulse(arbiter))),
+            .point = cpArbiterGetPointA(arbiter, 0),
+        });
+    }
+
+    // applies the contacts of the last physics step in a few linear passes: damage every hit
+    // block, then destroy dead blocks (whole ships when their hub died) and the projectiles
+    void process_contacts(EngineApi &api) {
+        if (m_contacts.empty())
+            return;
+
+        PROFILE_SCOPE("contacts");
+
+        std::sort(m_contacts.begin(), m_contacts.end(),
+                  [](const ContactRecord &a, const ContactRecord &b) { return a.block < b.block; });
+
+        const auto by_block = [](const ContactRecord &contact, EntityId id) {
+            return contact.block < id;
+        };
+
+        // scratch of this tick only, it lives in the frame arena
+        ArenaVector<EntityId> dead_blocks(api.frame_arena);
+        ArenaVector<EntityId> dead_ships(api.frame_arena);
+
+        m_world.query<const ShipId &, Health &>(
+            [&](EntityId id, const ShipId &ship_id, Health &health) {
+                auto it = std::lower_bound(m_contacts.begin(), m_contacts.end(), id, by_block);
+                if (it == m_contacts.end() || it->block != id)
+                    return;
+
+                for (; it != m_contacts.end() && it->block == id; ++it) {
+                    health.hit_points -= PROJECTILE_DAMAGE;
+                }
+
+                if (health.hit_points > 0.0f)
+                    return;
+
+                dead_blocks.push_back(id);
+                if (ship_id.id == id) {
+                    dead_ships.push_back(id);
+                }
+            });
+
+        std::sort(dead_blocks.begin(), dead_blocks.end());
+        std::sort(dead_ships.begin(), dead_ships.end());
+
+        if (!dead_blocks.empty()) {
+            const auto contains = [](const ArenaVector<EntityId> &sorted, EntityId id) {
+                return std::binary_search(sorted.begin(), sorted.end(), id);
+            };
+
+            m_world.remove_if<const RigidBody &, const ShipId &>(
+                [&](EntityId id, const RigidBody &body, const ShipId &ship_id) {
+                    if (!contains(dead_blocks, id) && !contains(dead_ships, ship_id.id))
+                        return false;
+
+                    if (!contains(dead_ships, ship_id.id)) {
+                        auto &parts = m_ships.at(ship_id.id).parts;
+                        std::erase_if(parts, [&](const RigidBody &part) {
+                            return part.body == body.body;
+                        });
+                    }
+
+                    destroy_body(body.body);
+                    return true;
+                });
+
+            for (auto ship_id : dead_ships) {
+                retire_ship(ship_id);
+            }
+        }
+
+        ArenaVector<EntityId> dead_projectiles(api.frame_arena);
+        dead_projectiles.reserve(m_contacts.size());
+        for (const auto &contact : m_contacts) {
+            dead_projectiles.push_back(contact.projectile);
+        }
+        std::sort(dead_projectiles.begin(), dead_projectiles.end());
+
+        m_world.remove_if<const RigidBody &, const Projectile &>(
+            [&](EntityId id, const RigidBody &body, const Projectile &) {
+                if (!std::binary_search(dead_projectiles.begin(), dead_projectiles.end(), id))
+                    return false;
+
+                destroy_body(body.body);
+                return true;
+            });
+    }
+
+    // publishes every sprite entity and the hits of this tick, not just what the camera sees
+    void export_state(EngineApi &api) {
+        if (!m_stream.is_open())
+            return;
+
+        PROFILE_SCOPE("state stream");
+        ArenaVector<StreamEntity> entities(api.frame_arena);
+        ArenaVector<StreamEvent> events(api.frame_arena);
+        entities.reserve(m_world.query_count<const RigidBody &, const Sprite &>());
+        events.reserve(m_contacts.size());
+
+        m_world.query<const RigidBody &, const Sprite &>(
+            [&](EntityId id, const RigidBody &body, const Sprite &sprite) {
+                auto position = body.position();
+                entities.push_back(StreamEntity{
+                    .id = id,
+                    .texture = m_stream.texture_index(sprite.handle),
+                    .overlay = 0,
+                    .x = quantize_position(position.x),
+                    .y = quantize_position(position.y),
+                    .rotation = quantize_angle(body.rotation()),
+                    .overlay_rotation = 0,
+                });
+            });
+
+        std::sort(entities.begin(), entities.end(),
+                  [](const StreamEntity &a, const StreamEntity &b) { return a.id < b.id; });
+
+        const auto set_overlay = [&](EntityId id, AssetHandle overlay, f32 rotation) {
+            auto it = std::lower_bound(
+                entities.begin(), entities.end(), id,
+                [](const StreamEntity &entity, EntityId id) { return entity.id < id; });
+            if (it == entities.end() || it->id != id)
+                return;
+
+            it->overlay = m_stream.texture_index(overlay) + 1;
+            it->overlay_rotation = quantize_angle(rotation);
+        };
+
+        m_world.query<const ShipRadar &>([&](EntityId id, const ShipRadar &radar) {
+            set_overlay(id, radar.dish_handle, radar.rotation);
+        });
+        m_world.query<const ShipGun &>([&](EntityId id, const ShipGun &gun) {
+            set_overlay(id, gun.gun_handle, gun.rotation);
+        });
+
+        for (const auto &contact : m_contacts) {
+            events.push_back(StreamEvent{
+                .type = StreamEventType::Hit,
+                .x = quantize_position(contact.point.x),
+                .y = quantize_position(contact.point.y),
+            });
+        }
+
+        m_stream.write_tick(m_step, entities, events);
+    }
+
+    // drops the script of a destroyed ship, with rollback it is kept until no rewind can reach
+    // back to the ship anymore
+    void retire_ship(EntityId ship_id) {
+        auto it = m_ships.find(ship_id);
+        if (it == m_ships.end())
+            return;
+
+        if (m_rollback.enabled()) {
+            m_fallen_ships[ship_id] = FallenShip{.step = m_step, .script = std::move(it->second)};
+        }
+
+        m_ships.erase(it);
+    }
+
+    // checkpoint layout: elapsed time, the raw world, then for every archetype with bodies one
+    // BodyCheckpoint per row of its capacity, then the joints of every ship. rows past the entity
+    // count are zero, so the layout only moves when an archetype grows
+    void save_checkpoint(EngineApi &api) {
+        if (!m_rollback.enabled())
+            return;
+
+        PROFILE_SCOPE("save checkpoint");
+        m_checkpoint.clear();
+        checkpoint_put(m_checkpoint, api.time.elapsed);
+        m_world.save_state(m_checkpoint);
+
+        const auto body_signature = m_world.signature_of<RigidBody>();
+        u64 body_archetypes = 0;
+        for (auto &[signature, archetype] : m_world.m_archetypes) {
+            body_archetypes += (signature & body_signature) == body_signature;
+        }
+        checkpoint_put(m_checkpoint, body_archetypes);
+
+        for (auto &[signature, archetype] : m_world.m_archetypes) {
+            if ((signature & body_signature) != body_signature)
+                continue;
+
+            checkpoint_put(m_checkpoint, signature.to_ullong());
+
+            auto start = m_checkpoint.size();
+            m_checkpoint.resize(start + archetype->capacity() * sizeof(BodyCheckpoint), 0);
+
+            auto bodies = static_cast<const RigidBody *>(archetype->storage_of(typeid(RigidBody)));
+            for (usize i = 0; i < archetype->entity_count(); ++i) {
+                auto state = body_checkpoint(bodies[i]);
+                std::memcpy(m_checkpoint.data() + start + i * sizeof(BodyCheckpoint), &state,
+                            sizeof(state));
+            }
+        }
+
+        u64 joint_count = 0;
+        for (const auto &[ship_id, ship] : m_ships) {
+            joint_count += ship.joints.size();
+        }
+        checkpoint_put(m_checkpoint, joint_count);
+
+        for (const auto &[ship_id, ship] : m_ships) {
+            for (const auto &[a, b] : ship.joints) {
+                checkpoint_put(m_checkpoint, ship_id);
+                checkpoint_put(m_checkpoint, a);
+                checkpoint_put(m_checkpoint, b);
+            }
+        }
+
+        m_checkpoint.resize((m_checkpoint.size() + sizeof(u64) - 1) / sizeof(u64) * sizeof(u64),
+                            0);
+        m_rollback.store(m_step, m_checkpoint);
+
+        std::erase_if(m_fallen_ships, [this](const auto &fallen) {
+            return fallen.second.step + m_options.rollback.capacity < m_step;
+        });
+    }
+
+    static BodyCheckpoint body_checkpoint(const RigidBody &body) {
+        const auto filter = cpShapeGetFilter(body.shape);
+        return BodyCheckpoint{
+            .position = cpBodyGetPosition(body.body),
+            .velocity = cpBodyGetVelocity(body.body),
+            .angle = cpBodyGetAngle(body.body),
+            .angular_velocity = cpBodyGetAngularVelocity(body.body),
+            .mass = cpBodyGetMass(body.body),
+            .moment = cpBodyGetMoment(body.body),
+            .size = body.size,
+            .group = filter.group,
+            .collision_type = cpShapeGetCollisionType(body.shape),
+        };
+    }
+
+    // restores the state after the tick ticks ago, the next update continues from there. lua is
+    // not rolled back: resimulating replays what the scripts commanded in the rewound ticks and
+    // hands control back to them once the current tick is reached again, a branch lets the
+    // scripts run on right away with whatever they remember of the discarded ticks
+    bool rewind(EngineApi &api, u64 ticks, RewindMode mode = RewindMode::Resimulate) {
+        if (!m_rollback.enabled() || m_replaying || m_recorder.is_open()) {
+            std::cerr << "Rewinding needs rollback and does not work while recording or replaying"
+                      << std::endl;
+            return false;
+        }
+
+        if (ticks == 0 || ticks >= m_step)
+            return false;
+
+        const auto target = m_step - ticks;
+        if (!m_rollback.load(target, m_checkpoint)) {
+            std::cerr << "Cant rewind " << ticks << " ticks, step " << target
+                      << " is no longer kept" << std::endl;
+            return false;
+        }
+
+        PROFILE_SCOPE("rewind");
+        restore_checkpoint(api);
+        m_rollback.rewound_to(target, m_checkpoint);
+
+        m_resimulate_until = mode == RewindMode::Resimulate ? std::max(m_resimulate_until, m_step)
+                                                            : 0;
+        m_step = target;
+        return true;
+    }
+
+    // rebuilds the world and the space from m_checkpoint. every body is created again, chipmunk
+    // only keeps the state in BodyCheckpoint, cached contacts and warm started joint impulses
+    // start over
+    void restore_checkpoint(EngineApi &api) {
+        m_world.query<const RigidBody &>(
+            [this](EntityId id, const RigidBody &body) { destroy_body(body.body); });
+        m_contacts.clear();
+
+        usize cursor = 0;
+        const auto elapsed = checkpoint_get<f32>(m_checkpoint, cursor);
+        always_assert(m_world.load_state(m_checkpoint, cursor),
+                      "rollback checkpoint does not belong to this world");
+
+        const auto body_archetypes = checkpoint_get<u64>(m_checkpoint, cursor);
+        for (u64 i = 0; i < body_archetypes; ++i) {
+            auto signature = World::Signature(checkpoint_get<u64>(m_checkpoint, cursor));
+            auto &archetype = m_world.m_archetypes.at(signature);
+
+            auto ids = static_cast<const EntityId *>(archetype->storage_of(typeid(EntityId)));
+            auto bodies = static_cast<RigidBody *>(archetype->storage_of(typeid(RigidBody)));
+            for (usize row = 0; row < archetype->capacity(); ++row) {
+                auto state = checkpoint_get<BodyCheckpoint>(m_checkpoint, cursor);
+                if (row < archetype->entity_count()) {
+                    create_body(bodies[row], state, ids[row]);
+                }
+            }
+        }
+
+        // ships that are not alive in the checkpoint keep their script for a resimulation
+        std::vector<EntityId> hubs;
+        m_world.query<const ShipBrain &>(
+            [&](EntityId id, const ShipBrain &) { hubs.push_back(id); });
+        std::sort(hubs.begin(), hubs.end());
+
+        for (auto it = m_ships.begin(); it != m_ships.end();) {
+            if (std::binary_search(hubs.begin(), hubs.end(), it->first)) {
+                ++it;
+                continue;
+            }
+
+            m_fallen_ships[it->first] = FallenShip{.step = m_step, .script = std::move(it->second)};
+            it = m_ships.erase(it);
+        }
+
+        for (auto hub : hubs) {
+            auto fallen = m_fallen_ships.find(hub);
+            if (fallen != m_fallen_ships.end()) {
+                m_ships[hub] = std::move(fallen->second.script);
+                m_fallen_ships.erase(fallen);
+            }
+
+            m_ships[hub].parts.clear();
+            m_ships[hub].joints.clear();
+        }
+
+        // ids grow in placement order, so sorting by id puts every hub in front of its parts
+        std::vector<std::tuple<EntityId, EntityId, RigidBody>> parts;
+        m_world.query<const RigidBody &, const ShipId &>(
+            [&](EntityId id, const RigidBody &body, const ShipId &ship_id) {
+                parts.emplace_back(id, ship_id.id, body);
             });
+        std::sort(parts.begin(), parts.end(), [](const auto &a, const auto &b) {
+            return std::get<0>(a) < std::get<0>(b);
+        });
+
+        for (const auto &[id, ship_id, body] : parts) {
+            m_ships[ship_id].parts.push_back(body);
+        }
+
+        const auto find_part = [&](EntityId id) -> const RigidBody * {
+            auto it = std::lower_bound(
+                parts.begin(), parts.end(), id,
+                [](const auto &part, EntityId id) { return std::get<0>(part) < id; });
+            return it != parts.end() && std::get<0>(*it) == id ? &std::get<2>(*it) : nullptr;
+        };
+
+        const auto joint_count = checkpoint_get<u64>(m_checkpoint, cursor);
+        for (u64 i = 0; i < joint_count; ++i) {
+            auto ship_id = checkpoint_get<EntityId>(m_checkpoint, cursor);
+            auto a = checkpoint_get<EntityId>(m_checkpoint, cursor);
+            auto b = checkpoint_get<EntityId>(m_checkpoint, cursor);
+
+            m_ships[ship_id].joints.emplace_back(a, b);
+
+            auto part_a = find_part(a);
+            auto part_b = find_part(b);
+            if (part_a && part_b) {
+                add_joint(*part_a, *part_b);
+            }
+        }
+
+        // sleeping needs the joints, it puts the whole ship to sleep at once
+        m_world.query<const RigidBody &, const ShipBrain &>(
+            [](EntityId id, const RigidBody &hub, const ShipBrain &brain) {
+                if (brain.lod == ShipLod::Asleep) {
+                    cpBodySleep(hub.body);
+                }
+            });
+
+        // the next update simulates the tick after the restored one
+        api.time.elapsed = elapsed + api.time.delta_time;
+    }
+
+    // gives a restored row a new body and shape, the stored pointers are stale
+    void create_body(RigidBody &rigid_body, const BodyCheckpoint &state, EntityId id) {
+        auto body = cpSpaceAddBody(m_space, m_physics.body(state.mass, state.moment));
+        auto shape = cpSpaceAddShape(m_space, m_physics.box(body, state.size.x, state.size.y));
+        cpShapeSetFilter(shape, cpShapeFilterNew(state.group, 0xFFFFFFFF, 0xFFFFFFFF));
+        cpShapeSetCollisionType(shape, state.collision_type);
+        cpBodySetUserData(body, reinterpret_cast<cpDataPointer>(id));
+
+        cpBodySetPosition(body, state.position);
+        cpBodySetAngle(body, state.angle);
+        cpBodySetVelocity(body, state.velocity);
+        cpBodySetAngularVelocity(body, state.angular_velocity);
+
+        rigid_body.body = body;
+        rigid_body.shape = shape;
+        rigid_body.size = state.size;
+    }
+
+    // removes a body with its shapes and constraints from the space and gives them back to the
+    // physics pool
+    void destroy_body(cpBody *body) { m_physics.destroy_body(m_space, body); }
+
+    // positions are refreshed in place, only entities that changed cells are moved
+    void update_spatial_grid() {
+        PROFILE_SCOPE("spatial grid");
+        m_spatial.begin_update();
+
+        m_world.query<const RigidBody &, const ShipBrain &>(
+            [this](EntityId id, const RigidBody &body, const ShipBrain &_) {
+                m_spatial.update(SpatialEntry{
+                    .id = id, .owner = id, .position = body.position(), .kind = SpatialKind::Ship});
+            });
+
+        m_world.query<const RigidBody &, const Projectile &>(
+            [this](EntityId id, const RigidBody &body, const Projectile &projectile) {
+                m_spatial.update(SpatialEntry{.id = id,
+                                              .owner = projectile.ship_id,
+                                              .position = body.position(),
+                                              .kind = SpatialKind::Projectile});
+            });
+
+        m_spatial.end_update();
+    }
+
+    sol::table entry_to_table(const SpatialEntry &entry, cpVect center) {
+        return m_lua.create_table_with("id", entry.id, "x", entry.position.x, "y",
+                                       entry.position.y, "distance",
+                                       cpvdist(entry.position, center));
+    }
+
+    // entities of the given kind within radius, excluding everything owned by ship_id.
+    // the radius is capped to the radar range, scripts cant sense further than a radar reaches
+    sol::table spatial_to_table(cpVect center, f64 radius, SpatialKind kind, EntityId ship_id) {
+        radius = std::clamp(radius, 0.0, RADAR_RANGE);
+
+        auto result = m_lua.create_table();
+        usize index = 1;
+        m_spatial.query_radius(center, radius, [&](const SpatialEntry &entry) {
+            if (entry.kind != kind || entry.owner == ship_id)
+                return;
+
+            result[index++] = entry_to_table(entry, center);
+        });
+
+        return result;
+    }
+
+    // casts every radar ray exactly once per tick, after all scripts declared their rotations.
+    // radar_ping only reads the cached distance, so the cost is bounded by the radar count instead
+    // of how often scripts call it. results are seen by the scripts on the next tick.
+    // the queries are not parallelized, cpSpace locking is not thread safe.
+    void sweep_radars() {
+        PROFILE_SCOPE("radar sweep");
+        m_world.query<const ShipId &, const RigidBody &, ShipRadar &>(
+            [this](EntityId id, const ShipId &ship_id, const RigidBody &radar_body,
+                   ShipRadar &radar) {
+                // the hub is always the first part of a ship
+                const auto &hub = m_ships.at(ship_id.id).parts.front();
+
+                // nobody reads the radars of sleeping ships, they wake up before their script
+                // runs again
+                if (cpBodyIsSleeping(hub.body))
+                    return;
+
+                auto total_rotation = hub.rotation() + radar.rotation;
+                auto origin = radar_body.position();
+                auto target = origin + cpvmult(cpvforangle(total_rotation), RADAR_RANGE);
+
+                cpSegmentQueryInfo result;
+                if (!cpSpaceSegmentQueryFirst(m_space, origin, target, 10.0f,
+                                              cpShapeFilterNew(ship_id.id, 0xFFFFFFFF, 0xFFFFFFFF),
+                                              &result)) {
+                    radar.ping_distance = 0.0f;
+                    return;
+                }
+
+                radar.ping_distance = static_cast<f32>(cpvlength(cpvsub(result.point, origin)));
+            });
+    }
+
+    void snapshot(EngineApi &api, RenderSnapshot &snapshot) override {
+        snapshot.previous_camera_x = previous_camera_x;
+        snapshot.previous_camera_y = previous_camera_y;
+        snapshot.camera_x = camera_x;
+        snapshot.camera_y = camera_y;
+
+        auto &base = snapshot.layer(RenderLayer::Base);
+        auto &overlay = snapshot.layer(RenderLayer::Overlay);
+
+        const auto instance_of = [](AssetHandle texture, const RigidBody &body,
+                                    f32 overlay_rotation) {
+            auto pos = body.position();
+            return SpriteInstance{
+                .texture = texture,
+                .previous_x = static_cast<f32>(body.previous_position.x),
+                .previous_y = static_cast<f32>(body.previous_position.y),
+                .previous_rotation = body.previous_rotation,
+                .x = static_cast<f32>(pos.x),
+                .y = static_cast<f32>(pos.y),
+                .rotation = body.rotation(),
+                .overlay_rotation = overlay_rotation,
+            };
+        };
+
+        // the renderer interpolates the camera, so the view covers both camera positions
+        const cpVect view_min{
+            .x = std::min(camera_x, previous_camera_x) - CULL_MARGIN,
+            .y = std::min(camera_y, previous_camera_y) - CULL_MARGIN,
+        };
+        const cpVect view_max{
+            .x = std::max(camera_x, previous_camera_x) + api.window_width + CULL_MARGIN,
+            .y = std::max(camera_y, previous_camera_y) + api.window_height + CULL_MARGIN,
+        };
+
+        // chipmunk already keeps every shape in a bounding box tree, every sprite entity has a
+        // body with one shape and its id as user data
+        ArenaVector<EntityId> visible(api.frame_arena);
+        {
+            PROFILE_SCOPE("sprite culling");
+            cpSpaceBBQuery(
+                m_space, cpBBNew(view_min.x, view_min.y, view_max.x, view_max.y),
+                CP_SHAPE_FILTER_ALL,
+                [](cpShape *shape, void *data) {
+                    auto ids = static_cast<ArenaVector<EntityId> *>(data);
+                    ids->push_back(reinterpret_cast<EntityId>(
+                        cpBodyGetUserData(cpShapeGetBody(shape))));
+                },
+                &visible);
+            std::sort(visible.begin(), visible.end());
+        }
+
+        const auto is_visible = [&](EntityId id) {
+            return std::binary_search(visible.begin(), visible.end(), id);
+        };
+
+        // only the id column is read for culled entities
+        usize sprites = 0;
+        m_world.query<const RigidBody &, const Sprite &>(
+            [&](EntityId id, const RigidBody &body, const Sprite &sprite) {
+                ++sprites;
+                if (is_visible(id)) {
+                    base.push_back(instance_of(sprite.handle, body, 0.0f));
+                }
+            });
+
+        m_world.query<const RigidBody &, const ShipRadar &>(
+            [&](EntityId id, const RigidBody &body, const ShipRadar &radar) {
+                if (is_visible(id)) {
+                    overlay.push_back(instance_of(radar.dish_handle, body, radar.rotation));
+                }
+            });
+        m_world.query<const RigidBody &, const ShipGun &>(
+            [&](EntityId id, const RigidBody &body, const ShipGun &gun) {
+                if (is_visible(id)) {
+                    overlay.push_back(instance_of(gun.gun_handle, body, gun.rotation));
+                }
+            });
+
+        snapshot.visible_count = base.size();
+        snapshot.culled_count = sprites - base.size();
+
+        write_stats(snapshot);
+    }
+
+    void write_stats(RenderSnapshot &snapshot) {
+        auto &text = snapshot.stats_text;
+        usize length = 0;
+        const auto append = [&](const char *format, auto... args) {
+            if (length >= text.size())
+                return;
+
+            auto written =
+                std::snprintf(text.data() + length, text.size() - length, format, args...);
+            length += written > 0 ? static_cast<usize>(written) : 0;
+        };
+
+        using ull = unsigned long long;
+
+        append("ships full %u  reduced %u  asleep %u  rollback %llu kb", m_lod_stats.full,
+               m_lod_stats.reduced, m_lod_stats.asleep,
+               static_cast<ull>(m_rollback.stored_bytes() / 1024));
+
+        const auto physics = m_physics.stats();
+        append("\nphysics pool %llu kb  bodies %llu  shapes %llu  constraints %llu",
+               static_cast<ull>(physics.bytes / 1024), static_cast<ull>(physics.bodies),
+               static_cast<ull>(physics.shapes), static_cast<ull>(physics.constraints));
+
+        append("\ncoroutines %u  total %.2f ms  max %.2f ms", m_coroutine_stats.resumed,
+               m_coroutine_stats.total_ns / 1e6, m_coroutine_stats.max_ns / 1e6);
+
+        m_archetype_memory.clear();
+        auto memory = m_world.memory_stats(&m_archetype_memory);
+        append("\nworld %llu kb  %llu rows  %.0f%% unused  %llu archetypes  %llu parked",
+               static_cast<ull>(memory.bytes / 1024), static_cast<ull>(memory.rows),
+               memory.fragmentation() * 100.0f, static_cast<ull>(memory.archetypes),
+               static_cast<ull>(memory.parked_archetypes));
+
+        std::sort(m_archetype_memory.begin(), m_archetype_memory.end(),
+                  [](const ArchetypeMemoryStats &a, const ArchetypeMemoryStats &b) {
+                      return a.bytes() > b.bytes();
+                  });
+
+        const auto listed = std::min<usize>(m_archetype_memory.size(), OVERLAY_ARCHETYPES);
+        for (usize i = 0; i < listed; ++i) {
+            const auto &archetype = m_archetype_memory[i];
+            append("\n  %016llx  rows %llu / %llu  %llu kb  %.0f%% unused%s",
+                   static_cast<ull>(archetype.signature), static_cast<ull>(archetype.rows),
+                   static_cast<ull>(archetype.capacity),
+                   static_cast<ull>(archetype.bytes() / 1024),
+                   archetype.fragmentation() * 100.0f, archetype.parked ? "  parked" : "");
+        }
+    }
+
+    void render(EngineApi &api, const RenderSnapshot &snapshot, f32 alpha) override {
+        PROFILE_SCOPE("ShipSimulationScene::render");
+        m_batch.draw_snapshot(api.renderer, api.assets.atlas, snapshot, alpha);
     }
 };
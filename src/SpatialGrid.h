@@ -0,0 +1,233 @@
+#pragma once
+
+#include "FlatMap.h"
+#include "defines.h"
+#include "ecs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <chipmunk/chipmunk.h>
+
+enum struct SpatialKind : u8 {
+    Ship = 0,
+    Projectile = 1,
+};
+
+struct SpatialEntry {
+    EntityId id;
+    // the ship this entry belongs to, for ships this is the entity itself
+    EntityId owner;
+    cpVect position;
+    SpatialKind kind;
+};
+
+// uniform grid over entity positions. entries are updated in place every tick and only move
+// between cells when they cross a cell border, entries that were not updated during a tick are
+// dropped at the end of the update. the Entry type needs an id and a position member.
+template <class Entry = SpatialEntry> struct SpatialGrid {
+    using CellKey = u64;
+
+    // emptied cells whose storage is kept for reuse, the ones beyond this give it back
+    static const usize KEPT_FREE_CELLS = 256;
+
+    struct Location {
+        CellKey cell;
+        usize index;
+        u64 stamp;
+    };
+
+    f64 m_cell_size;
+    u64 m_stamp;
+
+    // index into m_cell_entries of every cell that holds entries. cells are dropped once they
+    // become empty, so the table only grows with the cells occupied at the same time
+    FlatMap<CellKey, u32> m_cells;
+    std::vector<std::vector<Entry>> m_cell_entries;
+    std::vector<u32> m_free_cells;
+    // flat, so entities coming and going every tick do not allocate map nodes
+    FlatMap<EntityId, Location> m_locations;
+
+    SpatialGrid(f64 cell_size = 256.0) : m_cell_size(cell_size), m_stamp(0) {}
+
+    usize size() const { return m_locations.size(); }
+
+    void clear() {
+        m_cells.clear();
+        m_cell_entries.clear();
+        m_free_cells.clear();
+        m_locations.clear();
+    }
+
+    void begin_update() { ++m_stamp; }
+
+    void update(const Entry &entry) {
+        const auto key = cell_of(entry.position);
+
+        auto found = m_locations.find(entry.id);
+        if (!found) {
+            auto &cell = cell_at(key);
+            m_locations.insert(entry.id,
+                               Location{.cell = key, .index = cell.size(), .stamp = m_stamp});
+            cell.push_back(entry);
+            return;
+        }
+
+        auto &location = *found;
+        location.stamp = m_stamp;
+
+        if (location.cell == key) {
+            m_cell_entries[*m_cells.find(key)][location.index] = entry;
+            return;
+        }
+
+        remove_from_cell(location);
+
+        auto &cell = cell_at(key);
+        location.cell = key;
+        location.index = cell.size();
+        cell.push_back(entry);
+    }
+
+    // entry of id, for patching data that does not change the position
+    Entry *find(EntityId id) {
+        auto location = m_locations.find(id);
+        if (!location)
+            return nullptr;
+
+        return &m_cell_entries[*m_cells.find(location->cell)][location->index];
+    }
+
+    void end_update() {
+        m_locations.erase_if([this](EntityId id, const Location &location) {
+            if (location.stamp == m_stamp)
+                return false;
+
+            remove_from_cell(location);
+            return true;
+        });
+    }
+
+    template <class Fn> void query_aabb(cpVect min, cpVect max, Fn fn) const {
+        const auto min_x = cell_coordinate(min.x), min_y = cell_coordinate(min.y);
+        const auto max_x = cell_coordinate(max.x), max_y = cell_coordinate(max.y);
+
+        for (i32 y = min_y; y <= max_y; ++y) {
+            for (i32 x = min_x; x <= max_x; ++x) {
+                auto index = m_cells.find(key_of(x, y));
+                if (!index)
+                    continue;
+
+                for (const auto &entry : m_cell_entries[*index]) {
+                    if (entry.position.x < min.x || entry.position.x > max.x ||
+                        entry.position.y < min.y || entry.position.y > max.y)
+                        continue;
+
+                    fn(entry);
+                }
+            }
+        }
+    }
+
+    template <class Fn> void query_radius(cpVect center, f64 radius, Fn fn) const {
+        const cpVect extent{.x = radius, .y = radius};
+        const auto radius_sq = radius * radius;
+
+        query_aabb(cpvsub(center, extent), cpvadd(center, extent), [&](const Entry &entry) {
+            if (cpvdistsq(entry.position, center) <= radius_sq) {
+                fn(entry);
+            }
+        });
+    }
+
+    // collects up to count entries accepted by filter, closest first. the search radius starts
+    // at one cell and doubles until enough entries were found or max_radius is reached.
+    template <class Filter>
+    void query_nearest(cpVect center, usize count, f64 max_radius, Filter filter,
+                       std::vector<Entry> &out) const {
+        out.clear();
+        if (count == 0)
+            return;
+
+        f64 radius = std::min(m_cell_size, max_radius);
+        while (true) {
+            out.clear();
+            query_radius(center, radius, [&](const Entry &entry) {
+                if (filter(entry)) {
+                    out.push_back(entry);
+                }
+            });
+
+            if (out.size() >= count || radius >= max_radius)
+                break;
+
+            radius = std::min(radius * 2.0, max_radius);
+        }
+
+        const auto by_distance = [center](const Entry &a, const Entry &b) {
+            return cpvdistsq(a.position, center) < cpvdistsq(b.position, center);
+        };
+
+        if (out.size() > count) {
+            std::partial_sort(out.begin(), out.begin() + count, out.end(), by_distance);
+            out.resize(count);
+        } else {
+            std::sort(out.begin(), out.end(), by_distance);
+        }
+    }
+
+  private:
+    i32 cell_coordinate(f64 value) const {
+        return static_cast<i32>(std::floor(value / m_cell_size));
+    }
+
+    static CellKey key_of(i32 x, i32 y) {
+        return (static_cast<CellKey>(static_cast<u32>(x)) << 32) | static_cast<u32>(y);
+    }
+
+    CellKey cell_of(cpVect position) const {
+        return key_of(cell_coordinate(position.x), cell_coordinate(position.y));
+    }
+
+    // the cell with key, taken from the free cells when it holds nothing yet
+    std::vector<Entry> &cell_at(CellKey key) {
+        if (auto index = m_cells.find(key))
+            return m_cell_entries[*index];
+
+        u32 index;
+        if (!m_free_cells.empty()) {
+            index = m_free_cells.back();
+            m_free_cells.pop_back();
+        } else {
+            index = static_cast<u32>(m_cell_entries.size());
+            m_cell_entries.emplace_back();
+            // every cell can end up free at once, releasing one never allocates
+            m_free_cells.reserve(m_cell_entries.size());
+        }
+
+        m_cells.insert(key, index);
+        return m_cell_entries[index];
+    }
+
+    void remove_from_cell(const Location &location) {
+        const auto index = *m_cells.find(location.cell);
+        auto &cell = m_cell_entries[index];
+        debug_assert(location.index < cell.size(), "spatial grid location out of bounds");
+
+        if (location.index != cell.size() - 1) {
+            cell[location.index] = cell.back();
+            m_locations.find(cell[location.index].id)->index = location.index;
+        }
+
+        cell.pop_back();
+
+        if (cell.empty()) {
+            m_cells.erase(location.cell);
+            if (m_free_cells.size() >= KEPT_FREE_CELLS) {
+                cell.shrink_to_fit();
+            }
+            m_free_cells.push_back(index);
+        }
+    }
+};
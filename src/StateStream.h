@@ -0,0 +1,689 @@
+#pragma once
+
+#include "assert.h"
+#include "defines.h"
+#include "ecs.h"
+#include "engine/AssetHandle.h"
+#include "engine/LocalSocket.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// per tick state of every sprite entity, published by the simulation so viewers and analysis
+// tools do not have to run it themselves.
+//
+// layout: magic, version and the texture paths, then one length prefixed frame per tick. a
+// keyframe holds every entity, a delta frame only the entities that were removed, added or
+// changed since the previous frame. positions are quantized to 1/8 unit and angles to 16 bits,
+// deltas are taken between quantized values, so decoding never drifts. integers are LEB128
+// varints, signed ones zigzag encoded.
+
+const char STREAM_MAGIC[4] = {'N', 'A', 'V', 'S'};
+const u32 STREAM_VERSION = 1;
+const f64 STREAM_POSITION_SCALE = 8.0;
+// viewers joining a running stream wait at most this many ticks for a keyframe
+const u64 STREAM_KEYFRAME_INTERVAL = 60;
+// paths with this prefix are unix sockets instead of files
+const char STREAM_SOCKET_PREFIX[] = "unix:";
+
+enum struct StreamFrameType : u8 {
+    Keyframe = 0,
+    Delta = 1,
+};
+
+// what follows the id of an entity in a delta frame
+enum StreamEntityFlags : u8 {
+    // the whole entity like in a keyframe, nothing else is set
+    STREAM_NEW = 1 << 0,
+    STREAM_POSITION = 1 << 1,
+    STREAM_ROTATION = 1 << 2,
+    STREAM_OVERLAY = 1 << 3,
+};
+
+enum struct StreamEventType : u8 {
+    // a projectile hit a block at the event position
+    Hit = 0,
+};
+
+struct StreamEntity {
+    EntityId id;
+    // index into the texture paths of the stream
+    u32 texture;
+    // overlay texture index + 1, 0 without an overlay
+    u32 overlay;
+    i32 x, y;
+    u16 rotation;
+    u16 overlay_rotation;
+};
+
+struct StreamEvent {
+    StreamEventType type;
+    i32 x, y;
+};
+
+inline i32 quantize_position(f64 value) {
+    return static_cast<i32>(std::lround(value * STREAM_POSITION_SCALE));
+}
+
+inline f32 dequantize_position(i32 value) {
+    return static_cast<f32>(value / STREAM_POSITION_SCALE);
+}
+
+inline u16 quantize_angle(f64 angle) {
+    const f64 turn = 2.0 * std::numbers::pi;
+    auto wrapped = angle - turn * std::floor(angle / turn);
+    return static_cast<u16>(std::lround(wrapped / turn * 65536.0) & 0xFFFF);
+}
+
+inline f32 dequantize_angle(u16 angle) {
+    return static_cast<f32>(angle * (2.0 * std::numbers::pi / 65536.0));
+}
+
+inline void stream_put_varint(std::vector<u8> &out, u64 value) {
+    do {
+        u8 byte = value & 0x7F;
+        value >>= 7;
+        out.push_back(value ? byte | 0x80 : byte);
+    } while (value);
+}
+
+inline void stream_put_signed(std::vector<u8> &out, i64 value) {
+    stream_put_varint(out, (static_cast<u64>(value) << 1) ^ static_cast<u64>(value >> 63));
+}
+
+inline void stream_put_u16(std::vector<u8> &out, u16 value) {
+    out.push_back(value & 0xFF);
+    out.push_back(value >> 8);
+}
+
+inline void stream_put_u32(std::vector<u8> &out, u32 value) {
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        out.push_back((value >> shift) & 0xFF);
+    }
+}
+
+// bounds checked reads, reading past the end sets failed and returns zeros
+struct StreamReader {
+    std::span<const u8> data;
+    usize cursor = 0;
+    bool failed = false;
+
+    bool at_end() const { return cursor >= data.size(); }
+
+    u8 read_u8() {
+        if (cursor >= data.size()) {
+            failed = true;
+            return 0;
+        }
+
+        return data[cursor++];
+    }
+
+    u16 read_u16() {
+        u16 low = read_u8();
+        return low | static_cast<u16>(read_u8() << 8);
+    }
+
+    u32 read_u32() {
+        u32 value = 0;
+        for (u32 shift = 0; shift < 32; shift += 8) {
+            value |= static_cast<u32>(read_u8()) << shift;
+        }
+
+        return value;
+    }
+
+    u64 read_varint() {
+        u64 value = 0;
+        for (u32 shift = 0; shift < 64; shift += 7) {
+            u8 byte = read_u8();
+            value |= static_cast<u64>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+
+        return value;
+    }
+
+    // number of entries that follow, each of them at least one byte. larger counts fail instead
+    // of sizing a container from a corrupt varint
+    u64 read_count() {
+        auto count = read_varint();
+        if (count > data.size() - std::min<usize>(cursor, data.size())) {
+            failed = true;
+            return 0;
+        }
+
+        return count;
+    }
+
+    i64 read_signed() {
+        auto value = read_varint();
+        return static_cast<i64>(value >> 1) ^ -static_cast<i64>(value & 1);
+    }
+};
+
+class StateStreamEncoder {
+  public:
+    void header(const std::vector<std::string> &textures, std::vector<u8> &out) const {
+        out.insert(out.end(), STREAM_MAGIC, STREAM_MAGIC + sizeof(STREAM_MAGIC));
+        stream_put_u32(out, STREAM_VERSION);
+
+        stream_put_varint(out, textures.size());
+        for (const auto &path : textures) {
+            stream_put_varint(out, path.size());
+            out.insert(out.end(), path.begin(), path.end());
+        }
+    }
+
+    // appends the frame of one tick to out, entities must be sorted by id. delta frames are
+    // taken against the last encoded frame
+    void encode(u64 tick, std::span<const StreamEntity> entities,
+                std::span<const StreamEvent> events, bool keyframe, std::vector<u8> &out) {
+        const auto start = out.size();
+        // the frame length is filled in at the end
+        stream_put_u32(out, 0);
+
+        const auto type = keyframe ? StreamFrameType::Keyframe : StreamFrameType::Delta;
+        out.push_back(static_cast<u8>(type));
+        stream_put_varint(out, tick);
+
+        if (keyframe) {
+            stream_put_varint(out, entities.size());
+
+            EntityId last_id = 0;
+            for (const auto &entity : entities) {
+                stream_put_varint(out, entity.id - last_id);
+                last_id = entity.id;
+                put_entity(out, entity);
+            }
+        } else {
+            encode_changes(entities, out);
+        }
+
+        stream_put_varint(out, events.size());
+        for (const auto &event : events) {
+            out.push_back(static_cast<u8>(event.type));
+            stream_put_signed(out, event.x);
+            stream_put_signed(out, event.y);
+        }
+
+        m_previous.assign(entities.begin(), entities.end());
+
+        const auto length = static_cast<u32>(out.size() - start - 4);
+        for (u32 i = 0; i < 4; ++i) {
+            out[start + i] = (length >> (i * 8)) & 0xFF;
+        }
+    }
+
+  private:
+    static void put_entity(std::vector<u8> &out, const StreamEntity &entity) {
+        stream_put_varint(out, entity.texture);
+        stream_put_varint(out, entity.overlay);
+        stream_put_signed(out, entity.x);
+        stream_put_signed(out, entity.y);
+        stream_put_u16(out, entity.rotation);
+        if (entity.overlay) {
+            stream_put_u16(out, entity.overlay_rotation);
+        }
+    }
+
+    // removed ids, then every new or changed entity. entities that did not move cost nothing
+    void encode_changes(std::span<const StreamEntity> entities, std::vector<u8> &out) {
+        m_removed.clear();
+        m_changes.clear();
+        usize changed = 0;
+
+        EntityId last_id = 0;
+        usize previous = 0;
+        for (const auto &entity : entities) {
+            while (previous < m_previous.size() && m_previous[previous].id < entity.id) {
+                m_removed.push_back(m_previous[previous++].id);
+            }
+
+            const StreamEntity *before = nullptr;
+            if (previous < m_previous.size() && m_previous[previous].id == entity.id) {
+                before = &m_previous[previous++];
+            }
+
+            u8 flags = 0;
+            if (!before || before->texture != entity.texture || before->overlay != entity.overlay) {
+                flags = STREAM_NEW;
+            } else {
+                if (before->x != entity.x || before->y != entity.y)
+                    flags |= STREAM_POSITION;
+                if (before->rotation != entity.rotation)
+                    flags |= STREAM_ROTATION;
+                if (entity.overlay && before->overlay_rotation != entity.overlay_rotation)
+                    flags |= STREAM_OVERLAY;
+            }
+
+            if (flags == 0)
+                continue;
+
+            stream_put_varint(m_changes, entity.id - last_id);
+            last_id = entity.id;
+            m_changes.push_back(flags);
+            ++changed;
+
+            if (flags & STREAM_NEW) {
+                put_entity(m_changes, entity);
+                continue;
+            }
+
+            if (flags & STREAM_POSITION) {
+                stream_put_signed(m_changes, static_cast<i64>(entity.x) - before->x);
+                stream_put_signed(m_changes, static_cast<i64>(entity.y) - before->y);
+            }
+            if (flags & STREAM_ROTATION) {
+                // the wrapped difference is the short way around
+                stream_put_signed(m_changes, static_cast<i16>(entity.rotation - before->rotation));
+            }
+            if (flags & STREAM_OVERLAY) {
+                stream_put_signed(m_changes, static_cast<i16>(entity.overlay_rotation -
+                                                              before->overlay_rotation));
+            }
+        }
+
+        while (previous < m_previous.size()) {
+            m_removed.push_back(m_previous[previous++].id);
+        }
+
+        stream_put_varint(out, m_removed.size());
+        EntityId last_removed = 0;
+        for (auto id : m_removed) {
+            stream_put_varint(out, id - last_removed);
+            last_removed = id;
+        }
+
+        stream_put_varint(out, changed);
+        out.insert(out.end(), m_changes.begin(), m_changes.end());
+    }
+
+    std::vector<StreamEntity> m_previous;
+    std::vector<EntityId> m_removed;
+    std::vector<u8> m_changes;
+};
+
+class StateStreamDecoder {
+  public:
+    // parses the stream header, returns the bytes it took or 0 while data is incomplete
+    usize read_header(std::span<const u8> data) {
+        StreamReader reader{.data = data};
+        if (data.size() < 8)
+            return 0;
+
+        if (std::memcmp(data.data(), STREAM_MAGIC, sizeof(STREAM_MAGIC)) != 0) {
+            std::cerr << "Not a state stream" << std::endl;
+            m_failed = true;
+            return 0;
+        }
+
+        reader.cursor = sizeof(STREAM_MAGIC);
+        if (reader.read_u32() != STREAM_VERSION) {
+            std::cerr << "Unsupported state stream version" << std::endl;
+            m_failed = true;
+            return 0;
+        }
+
+        // a count past the end is a header that did not fully arrive yet or a corrupt one,
+        // either way nothing is allocated for it
+        std::vector<std::string> textures(reader.read_count());
+        for (auto &path : textures) {
+            auto length = reader.read_varint();
+            if (reader.failed || reader.cursor + length > data.size())
+                return 0;
+
+            path.assign(reinterpret_cast<const char *>(data.data() + reader.cursor), length);
+            reader.cursor += length;
+        }
+
+        if (reader.failed)
+            return 0;
+
+        m_textures = std::move(textures);
+        return reader.cursor;
+    }
+
+    // decodes one frame without its length prefix. delta frames before the first keyframe are
+    // skipped, returns false for corrupt frames
+    bool decode(std::span<const u8> frame) {
+        StreamReader reader{.data = frame};
+        auto type = static_cast<StreamFrameType>(reader.read_u8());
+        auto tick = reader.read_varint();
+
+        if (type == StreamFrameType::Delta && !m_has_state)
+            return true;
+
+        m_previous.swap(m_entities);
+        m_entities.clear();
+
+        if (type == StreamFrameType::Keyframe) {
+            auto count = reader.read_count();
+            EntityId id = 0;
+            for (u64 i = 0; i < count && !reader.failed; ++i) {
+                id += reader.read_varint();
+                m_entities.push_back(read_entity(reader, id));
+            }
+        } else if (type == StreamFrameType::Delta) {
+            decode_changes(reader);
+        } else {
+            reader.failed = true;
+        }
+
+        m_events.clear();
+        auto event_count = reader.read_count();
+        for (u64 i = 0; i < event_count && !reader.failed; ++i) {
+            auto event_type = static_cast<StreamEventType>(reader.read_u8());
+            auto x = static_cast<i32>(reader.read_signed());
+            auto y = static_cast<i32>(reader.read_signed());
+            m_events.push_back(StreamEvent{.type = event_type, .x = x, .y = y});
+        }
+
+        if (reader.failed) {
+            std::cerr << "Corrupt state stream frame at tick " << tick << std::endl;
+            m_has_state = false;
+            return false;
+        }
+
+        m_tick = tick;
+        m_has_state = true;
+        return true;
+    }
+
+    bool failed() const { return m_failed; }
+    bool has_state() const { return m_has_state; }
+
+    const std::vector<std::string> &textures() const { return m_textures; }
+
+    u64 tick() const { return m_tick; }
+    // sorted by id, previous is the state before the last decoded frame
+    const std::vector<StreamEntity> &entities() const { return m_entities; }
+    const std::vector<StreamEntity> &previous() const { return m_previous; }
+    const std::vector<StreamEvent> &events() const { return m_events; }
+
+  private:
+    static StreamEntity read_entity(StreamReader &reader, EntityId id) {
+        StreamEntity entity{};
+        entity.id = id;
+        entity.texture = static_cast<u32>(reader.read_varint());
+        entity.overlay = static_cast<u32>(reader.read_varint());
+        entity.x = static_cast<i32>(reader.read_signed());
+        entity.y = static_cast<i32>(reader.read_signed());
+        entity.rotation = reader.read_u16();
+        if (entity.overlay) {
+            entity.overlay_rotation = reader.read_u16();
+        }
+
+        return entity;
+    }
+
+    // merges the removed ids and changes into the previous state, all three are sorted by id
+    void decode_changes(StreamReader &reader) {
+        m_removed.resize(reader.read_count());
+        EntityId removed_id = 0;
+        for (auto &id : m_removed) {
+            removed_id += reader.read_varint();
+            id = removed_id;
+        }
+
+        usize previous = 0;
+        usize removed = 0;
+        // unchanged entities are carried over unless they were removed
+        const auto keep = [&](const StreamEntity &entity) {
+            while (removed < m_removed.size() && m_removed[removed] < entity.id)
+                ++removed;
+
+            if (removed < m_removed.size() && m_removed[removed] == entity.id)
+                return;
+
+            m_entities.push_back(entity);
+        };
+
+        auto count = reader.read_count();
+        EntityId id = 0;
+        for (u64 i = 0; i < count && !reader.failed; ++i) {
+            id += reader.read_varint();
+            auto flags = reader.read_u8();
+
+            while (previous < m_previous.size() && m_previous[previous].id < id) {
+                keep(m_previous[previous++]);
+            }
+
+            const bool existed = previous < m_previous.size() && m_previous[previous].id == id;
+
+            if (flags & STREAM_NEW) {
+                previous += existed ? 1 : 0;
+                m_entities.push_back(read_entity(reader, id));
+                continue;
+            }
+
+            if (!existed) {
+                reader.failed = true;
+                return;
+            }
+
+            auto entity = m_previous[previous++];
+            if (flags & STREAM_POSITION) {
+                entity.x += static_cast<i32>(reader.read_signed());
+                entity.y += static_cast<i32>(reader.read_signed());
+            }
+            if (flags & STREAM_ROTATION) {
+                entity.rotation += static_cast<u16>(reader.read_signed());
+            }
+            if (flags & STREAM_OVERLAY) {
+                entity.overlay_rotation += static_cast<u16>(reader.read_signed());
+            }
+
+            m_entities.push_back(entity);
+        }
+
+        while (previous < m_previous.size()) {
+            keep(m_previous[previous++]);
+        }
+    }
+
+    std::vector<std::string> m_textures;
+    bool m_failed = false;
+    bool m_has_state = false;
+
+    u64 m_tick = 0;
+    std::vector<StreamEntity> m_entities;
+    std::vector<StreamEntity> m_previous;
+    std::vector<StreamEvent> m_events;
+    std::vector<EntityId> m_removed;
+};
+
+// publishes encoded ticks to a file, or to every viewer connected to a unix socket when the path
+// starts with unix:. a socket without viewers skips the encoding, a viewer that connects gets
+// the header and a keyframe on the next tick
+class StateStreamWriter {
+  public:
+    bool open(const std::string &path,
+              const std::vector<std::pair<AssetHandle, std::string>> &textures) {
+        std::vector<std::string> paths;
+        for (const auto &[handle, texture_path] : textures) {
+            m_texture_indices[handle] = static_cast<u32>(paths.size());
+            paths.push_back(texture_path);
+        }
+
+        m_header.clear();
+        m_encoder.header(paths, m_header);
+
+        if (path.starts_with(STREAM_SOCKET_PREFIX)) {
+            m_use_socket = m_socket.listen(path.substr(sizeof(STREAM_SOCKET_PREFIX) - 1));
+            return m_use_socket;
+        }
+
+        m_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_file) {
+            return false;
+        }
+
+        m_file.write(reinterpret_cast<const char *>(m_header.data()),
+                     static_cast<std::streamsize>(m_header.size()));
+        return true;
+    }
+
+    bool is_open() const { return m_use_socket || m_file.is_open(); }
+
+    u32 texture_index(AssetHandle handle) const {
+        auto it = m_texture_indices.find(handle);
+        debug_assert(it != m_texture_indices.end(), "texture is not in the state stream");
+        return it != m_texture_indices.end() ? it->second : 0;
+    }
+
+    void write_tick(u64 tick, std::span<const StreamEntity> entities,
+                    std::span<const StreamEvent> events) {
+        if (m_use_socket) {
+            if (m_socket.accept_clients(m_header) > 0) {
+                m_force_keyframe = true;
+            }
+
+            if (m_socket.client_count() == 0) {
+                m_force_keyframe = true;
+                return;
+            }
+        }
+
+        const bool keyframe =
+            m_force_keyframe || m_ticks_since_keyframe >= STREAM_KEYFRAME_INTERVAL;
+        m_force_keyframe = false;
+        m_ticks_since_keyframe = keyframe ? 1 : m_ticks_since_keyframe + 1;
+
+        m_frame.clear();
+        m_encoder.encode(tick, entities, events, keyframe, m_frame);
+
+        if (m_use_socket) {
+            m_socket.broadcast(m_frame);
+        } else {
+            m_file.write(reinterpret_cast<const char *>(m_frame.data()),
+                         static_cast<std::streamsize>(m_frame.size()));
+        }
+    }
+
+  private:
+    StateStreamEncoder m_encoder;
+    std::unordered_map<AssetHandle, u32> m_texture_indices;
+    std::vector<u8> m_header;
+    std::vector<u8> m_frame;
+
+    std::ofstream m_file;
+    LocalSocketServer m_socket;
+    bool m_use_socket = false;
+
+    bool m_force_keyframe = true;
+    u64 m_ticks_since_keyframe = 0;
+};
+
+// reads a state stream from a file, also while it is still being written, or from a unix socket
+class StateStreamReader {
+  public:
+    bool open(const std::string &path) {
+        if (path.starts_with(STREAM_SOCKET_PREFIX)) {
+            m_live = m_socket.connect(path.substr(sizeof(STREAM_SOCKET_PREFIX) - 1));
+            return m_live;
+        }
+
+        m_file.open(path, std::ios::binary);
+        return m_file.is_open();
+    }
+
+    // live streams are shown as they arrive, files are played back one frame per tick
+    bool is_live() const { return m_live; }
+    bool has_header() const { return m_has_header; }
+
+    const StateStreamDecoder &state() const { return m_decoder; }
+
+    // decodes at most max_frames of the frames that arrived, returns how many were decoded
+    usize poll(usize max_frames) {
+        usize decoded = 0;
+
+        while (decoded < max_frames && !m_decoder.failed()) {
+            if (!m_has_header) {
+                auto consumed = m_decoder.read_header(pending());
+                if (consumed == 0) {
+                    if (!read_more())
+                        break;
+                    continue;
+                }
+
+                m_has_header = true;
+                m_cursor += consumed;
+            }
+
+            auto frame = next_frame();
+            if (!frame) {
+                if (!read_more())
+                    break;
+                continue;
+            }
+
+            m_decoder.decode(*frame);
+            ++decoded;
+        }
+
+        // drop the consumed bytes once they make up most of the buffer
+        if (m_cursor > m_buffer.size() / 2) {
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_cursor);
+            m_cursor = 0;
+        }
+
+        return decoded;
+    }
+
+  private:
+    std::span<const u8> pending() const {
+        return std::span<const u8>(m_buffer).subspan(m_cursor);
+    }
+
+    std::optional<std::span<const u8>> next_frame() {
+        StreamReader reader{.data = pending()};
+        auto length = reader.read_u32();
+        if (reader.failed || reader.cursor + length > reader.data.size())
+            return std::nullopt;
+
+        m_cursor += reader.cursor + length;
+        return reader.data.subspan(reader.cursor, length);
+    }
+
+    // false if nothing new arrived
+    bool read_more() {
+        const auto before = m_buffer.size();
+
+        if (m_live) {
+            m_socket.receive(m_buffer);
+        } else if (m_file.is_open()) {
+            char chunk[64 * 1024];
+            m_file.read(chunk, sizeof(chunk));
+            m_buffer.insert(m_buffer.end(), chunk, chunk + m_file.gcount());
+
+            // the file may still grow, the next read tries again
+            if (m_file.eof()) {
+                m_file.clear();
+            }
+        }
+
+        return m_buffer.size() > before;
+    }
+
+    StateStreamDecoder m_decoder;
+    bool m_has_header = false;
+    bool m_live = false;
+
+    std::ifstream m_file;
+    LocalSocketClient m_socket;
+
+    std::vector<u8> m_buffer;
+    usize m_cursor = 0;
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include "engine/EngineApi.h"
+#include "engine/IScene.h"
+#include "engine/Profiler.h"
+#include "engine/RenderSnapshot.h"
+#include "engine/SpriteBatch.h"
+
+#include "StateStream.h"
+
+// renders a state stream written by another navis-lua process instead of simulating, so one
+// headless simulation can feed any number of viewers. only the camera is local
+struct StreamViewerScene : public IScene {
+    std::string m_path;
+    StateStreamReader m_reader;
+
+    // atlas handles of the texture indices in the stream
+    std::vector<AssetHandle> m_textures;
+
+    f32 camera_x = 0.0f, camera_y = 0.0f;
+    f32 previous_camera_x = 0.0f, previous_camera_y = 0.0f;
+
+    // only used on the render thread
+    SpriteBatch m_batch;
+
+    explicit StreamViewerScene(const std::string *path) : m_path(*path) {}
+
+    void on_enter(EngineApi &api) override {
+        if (!m_reader.open(m_path)) {
+            std::cerr << "Cant open state stream: " << m_path << std::endl;
+        }
+    }
+
+    void update(EngineApi &api) override {
+        PROFILE_SCOPE("StreamViewerScene::update");
+        const f32 CAMERA_SPEED = 20.0f;
+
+        previous_camera_x = camera_x;
+        previous_camera_y = camera_y;
+
+        if (api.up) {
+            camera_y -= CAMERA_SPEED;
+        }
+        if (api.down) {
+            camera_y += CAMERA_SPEED;
+        }
+        if (api.left) {
+            camera_x -= CAMERA_SPEED;
+        }
+        if (api.right) {
+            camera_x += CAMERA_SPEED;
+        }
+
+        // live streams catch up to the newest tick, files play back at the recorded speed
+        m_reader.poll(m_reader.is_live() ? SIZE_MAX : 1);
+
+        if (m_reader.has_header() && m_textures.empty()) {
+            for (const auto &path : m_reader.state().textures()) {
+                m_textures.push_back(api.assets.atlas.add(path.c_str()));
+            }
+        }
+    }
+
+    void snapshot(EngineApi &api, RenderSnapshot &snapshot) override {
+        snapshot.previous_camera_x = previous_camera_x;
+        snapshot.previous_camera_y = previous_camera_y;
+        snapshot.camera_x = camera_x;
+        snapshot.camera_y = camera_y;
+
+        const auto &state = m_reader.state();
+        if (!state.has_state())
+            return;
+
+        auto &base = snapshot.layer(RenderLayer::Base);
+        auto &overlay = snapshot.layer(RenderLayer::Overlay);
+
+        // same margin as the simulation, covers the largest sprite and the camera movement
+        const f32 CULL_MARGIN = 64.0f;
+        const f32 view_min_x = std::min(camera_x, previous_camera_x) - CULL_MARGIN;
+        const f32 view_min_y = std::min(camera_y, previous_camera_y) - CULL_MARGIN;
+        const f32 view_max_x =
+            std::max(camera_x, previous_camera_x) + api.window_width + CULL_MARGIN;
+        const f32 view_max_y =
+            std::max(camera_y, previous_camera_y) + api.window_height + CULL_MARGIN;
+
+        const auto &previous = state.previous();
+        usize previous_index = 0;
+
+        for (const auto &entity : state.entities()) {
+            while (previous_index < previous.size() && previous[previous_index].id < entity.id) {
+                ++previous_index;
+            }
+
+            const bool moved = previous_index < previous.size() &&
+                               previous[previous_index].id == entity.id;
+            const auto &before = moved ? previous[previous_index] : entity;
+
+            const auto x = dequantize_position(entity.x);
+            const auto y = dequantize_position(entity.y);
+            if (x < view_min_x || x > view_max_x || y < view_min_y || y > view_max_y ||
+                entity.texture >= m_textures.size() || entity.overlay > m_textures.size()) {
+                ++snapshot.culled_count;
+                continue;
+            }
+
+            // the stream wraps angles, the renderer lerps them, so take the short way around
+            const auto rotation = dequantize_angle(entity.rotation);
+            const auto previous_rotation =
+                rotation - std::remainder(rotation - dequantize_angle(before.rotation),
+                                          2.0f * std::numbers::pi_v<f32>);
+
+            SpriteInstance instance{
+                .texture = m_textures[entity.texture],
+                .previous_x = dequantize_position(before.x),
+                .previous_y = dequantize_position(before.y),
+                .previous_rotation = previous_rotation,
+                .x = x,
+                .y = y,
+                .rotation = rotation,
+                .overlay_rotation = 0.0f,
+            };
+            base.push_back(instance);
+
+            if (entity.overlay) {
+                instance.texture = m_textures[entity.overlay - 1];
+                instance.overlay_rotation = dequantize_angle(entity.overlay_rotation);
+                overlay.push_back(instance);
+            }
+        }
+
+        snapshot.visible_count = base.size();
+
+        std::snprintf(snapshot.stats_text.data(), snapshot.stats_text.size(),
+                      "stream tick %llu  entities %llu  hits %llu",
+                      static_cast<unsigned long long>(state.tick()),
+                      static_cast<unsigned long long>(state.entities().size()),
+                      static_cast<unsigned long long>(state.events().size()));
+    }
+
+    void render(EngineApi &api, const RenderSnapshot &snapshot, f32 alpha) override {
+        PROFILE_SCOPE("StreamViewerScene::render");
+        m_batch.draw_snapshot(api.renderer, api.assets.atlas, snapshot, alpha);
+    }
+};
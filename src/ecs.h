@@ -2,28 +2,51 @@
 
 #include "assert.h"
 #include "defines.h"
+#include "engine/FrameArena.h"
+#include "engine/Profiler.h"
 
+#include <algorithm>
 #include <bitset>
 #include <cstring>
 #include <memory>
 #include <optional>
+#include <span>
 #include <tuple>
 #include <type_traits>
 #include <typeindex>
 #include <unordered_map>
+#include <vector>
 
 using EntityId = usize;
 
 struct IArchetype {
     static const usize INITIAL_CAPACITY = 8;
     static const usize GROW_FACTOR = 2;
+    // shrink gives capacity back once less than 1 / SHRINK_FACTOR of it is used
+    static const usize SHRINK_FACTOR = 4;
+
+    // set while World::compact has taken the archetype out of query iteration
+    bool parked = false;
+    // changes whenever rows move or the storage is reallocated, pointers into the columns taken
+    // at another version are stale
+    u64 version = 0;
 
     virtual ~IArchetype() = default;
 
     virtual usize entity_count() = 0;
+    virtual usize row_size() = 0;
+    virtual void shrink() = 0;
     virtual bool remove_entity(const EntityId &) = 0;
+    // removes every row i with remove[i] != 0 in one pass, returns how many were removed
+    virtual usize remove_rows(const u8 *remove) = 0;
     virtual void *storage_of(const std::type_index &type) = 0;
     virtual void clear() = 0;
+
+    // raw rows for checkpoints: the ids, then one column per component, each capacity() long
+    virtual usize capacity() = 0;
+    virtual std::span<const u8> raw_storage() = 0;
+    virtual void restore_raw_storage(usize capacity, usize entity_count,
+                                     std::span<const u8> bytes) = 0;
 };
 
 template <typename... Components> struct Archetype : public IArchetype {
@@ -44,6 +67,8 @@ template <typename... Components> struct Archetype : public IArchetype {
 
     usize entity_count() override { return m_entity_count; }
 
+    usize row_size() override { return ARCHETYPE_SIZE; }
+
     template <typename Component> Component *storage_of() {
         return reinterpret_cast<Component *>(m_storage + offset_of<Component>() * m_capacity);
     }
@@ -83,6 +108,7 @@ template <typename... Components> struct Archetype : public IArchetype {
                     ...);
 
                 m_entity_count--;
+                ++version;
 
                 return true;
             }
@@ -91,7 +117,67 @@ template <typename... Components> struct Archetype : public IArchetype {
         return false;
     }
 
-    void clear() override { m_entity_count = 0; }
+    // compacts the kept rows to the front, the order of the remaining entities is preserved
+    usize remove_rows(const u8 *remove) override {
+        auto ids = storage_of<EntityId>();
+
+        usize kept = 0;
+        for (usize i = 0; i < m_entity_count; ++i) {
+            if (remove[i])
+                continue;
+
+            if (kept != i) {
+                ids[kept] = ids[i];
+                ((storage_of<Components>()[kept] = std::move(storage_of<Components>()[i])), ...);
+            }
+
+            ++kept;
+        }
+
+        auto removed = m_entity_count - kept;
+        m_entity_count = kept;
+        version += removed != 0;
+        return removed;
+    }
+
+    void clear() override {
+        m_entity_count = 0;
+        ++version;
+    }
+
+    void reserve(usize capacity) { ensure_capacity(capacity); }
+
+    // keeps room for the rows to grow by GROW_FACTOR before the next reallocation
+    void shrink() override {
+        if (m_capacity <= IArchetype::INITIAL_CAPACITY ||
+            m_entity_count * IArchetype::SHRINK_FACTOR > m_capacity)
+            return;
+
+        reallocate(std::max(m_entity_count * IArchetype::GROW_FACTOR,
+                            usize{IArchetype::INITIAL_CAPACITY}));
+    }
+
+    usize capacity() override { return m_capacity; }
+
+    std::span<const u8> raw_storage() override {
+        return std::span<const u8>(m_storage, m_capacity * ARCHETYPE_SIZE);
+    }
+
+    void restore_raw_storage(usize capacity, usize entity_count,
+                             std::span<const u8> bytes) override {
+        always_assert(bytes.size() == capacity * ARCHETYPE_SIZE && entity_count <= capacity,
+                      "raw storage does not fit the archetype");
+
+        if (capacity != m_capacity) {
+            operator delete(m_storage);
+            m_storage = reinterpret_cast<u8 *>(operator new(capacity * ARCHETYPE_SIZE));
+            m_capacity = capacity;
+        }
+
+        std::memcpy(m_storage, bytes.data(), bytes.size());
+        m_entity_count = entity_count;
+        ++version;
+    }
 
   private:
     void ensure_capacity(usize required_capacity) {
@@ -101,9 +187,13 @@ template <typename... Components> struct Archetype : public IArchetype {
 
         usize new_capacity = m_capacity;
         do {
-            new_capacity = m_capacity * IArchetype::GROW_FACTOR;
+            new_capacity *= IArchetype::GROW_FACTOR;
         } while (new_capacity < required_capacity);
 
+        reallocate(new_capacity);
+    }
+
+    void reallocate(usize new_capacity) {
         u8 *new_storage = reinterpret_cast<u8 *>(operator new(new_capacity * ARCHETYPE_SIZE));
 
         void *source = storage_of<EntityId>();
@@ -122,6 +212,7 @@ template <typename... Components> struct Archetype : public IArchetype {
         operator delete(m_storage);
         m_storage = new_storage;
         m_capacity = new_capacity;
+        ++version;
     }
 
     template <typename Component> constexpr usize offset_of() const {
@@ -142,6 +233,62 @@ template <typename... Components> struct Archetype : public IArchetype {
 
 const usize COMPONENT_COUNT = 64;
 
+// archetype resolved once for a component set, spawning through it skips the signature hash, the
+// archetype lookup and the cast. valid as long as the world it came from.
+template <class... Components> struct ArchetypeHandle {
+    Archetype<Components...> *archetype = nullptr;
+};
+
+// cached pointers to the components of one entity, so repeated access skips the lookup in
+// World::get. they stay usable while the version of the archetype is unchanged, after that
+// World::refresh looks the entity up again.
+template <class... Components> struct EntityRef {
+    EntityId id = 0;
+    std::tuple<Components *...> components{};
+    const IArchetype *archetype = nullptr;
+    u64 version = 0;
+
+    bool valid() const { return archetype && archetype->version == version; }
+
+    template <class Component> Component &get() const { return *std::get<Component *>(components); }
+};
+
+// ids handed out by one batch spawn, they are contiguous
+struct EntityRange {
+    EntityId first;
+    usize count;
+
+    EntityId operator[](usize index) const { return first + index; }
+};
+
+struct ArchetypeMemoryStats {
+    // bit i is set for the component with index i
+    u64 signature;
+    usize rows;
+    usize capacity;
+    usize row_bytes;
+    bool parked;
+
+    usize bytes() const { return capacity * row_bytes; }
+    usize unused_bytes() const { return (capacity - rows) * row_bytes; }
+    // share of the storage that holds no rows
+    f32 fragmentation() const {
+        return capacity ? static_cast<f32>(capacity - rows) / static_cast<f32>(capacity) : 0.0f;
+    }
+};
+
+struct WorldMemoryStats {
+    usize archetypes = 0;
+    usize parked_archetypes = 0;
+    usize rows = 0;
+    usize bytes = 0;
+    usize unused_bytes = 0;
+
+    f32 fragmentation() const {
+        return bytes ? static_cast<f32>(unused_bytes) / static_cast<f32>(bytes) : 0.0f;
+    }
+};
+
 struct World {
     using Signature = std::bitset<COMPONENT_COUNT>;
 
@@ -150,8 +297,15 @@ struct World {
 
     std::unordered_map<std::type_index, usize> m_component_indices;
     std::unordered_map<Signature, std::unique_ptr<IArchetype>> m_archetypes;
+    // empty archetypes compact took out of m_archetypes. they stay alive for their handles and
+    // return on the next spawn into them
+    std::unordered_map<Signature, std::unique_ptr<IArchetype>> m_parked_archetypes;
     u8 m_queries_in_progress;
 
+    // scratch for bulk removals, kept to reuse the storage
+    std::vector<u8> m_removal_mask;
+    std::vector<EntityId> m_removal_ids;
+
     World()
         : m_component_count(0),
           m_next_entity_id(1),
@@ -179,6 +333,132 @@ struct World {
         return signature;
     }
 
+    // appends a raw copy of every archetype for rollback checkpoints. components are copied
+    // bytewise, pointers inside of them have to be fixed up by whoever loads the state
+    void save_state(std::vector<u8> &out) {
+        always_assert(m_queries_in_progress == 0, "cant save during active query");
+
+        const auto put = [&out](u64 value) {
+            auto bytes = reinterpret_cast<const u8 *>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(value));
+        };
+
+        put(m_next_entity_id);
+        put(m_archetypes.size());
+
+        for (auto &[signature, archetype] : m_archetypes) {
+            auto storage = archetype->raw_storage();
+            put(signature.to_ullong());
+            put(archetype->capacity());
+            put(archetype->entity_count());
+            put(storage.size());
+            out.insert(out.end(), storage.begin(), storage.end());
+        }
+    }
+
+    // restores what save_state wrote, starting at cursor. archetypes missing from the state are
+    // emptied. returns false if the state does not belong to this world
+    bool load_state(std::span<const u8> in, usize &cursor) {
+        always_assert(m_queries_in_progress == 0, "cant load during active query");
+
+        bool failed = false;
+        const auto get = [&]() {
+            u64 value = 0;
+            if (cursor + sizeof(value) > in.size()) {
+                failed = true;
+                return value;
+            }
+
+            std::memcpy(&value, in.data() + cursor, sizeof(value));
+            cursor += sizeof(value);
+            return value;
+        };
+
+        auto next_entity_id = get();
+        auto archetype_count = get();
+
+        for (auto &[signature, archetype] : m_archetypes) {
+            archetype->clear();
+        }
+
+        for (u64 i = 0; i < archetype_count && !failed; ++i) {
+            const auto signature = Signature(get());
+            auto it = m_archetypes.find(signature);
+            if (it == m_archetypes.end()) {
+                it = unpark(signature);
+            }
+
+            auto capacity = get();
+            auto entity_count = get();
+            auto size = get();
+
+            if (failed || it == m_archetypes.end() || cursor + size > in.size())
+                return false;
+
+            it->second->restore_raw_storage(capacity, entity_count, in.subspan(cursor, size));
+            cursor += size;
+        }
+
+        m_next_entity_id = next_entity_id;
+        return !failed;
+    }
+
+    // releases unused archetype capacity and takes empty archetypes out of query iteration.
+    // handles to parked archetypes stay valid
+    void compact() {
+        always_assert(m_queries_in_progress == 0, "cant compact during active query");
+
+        for (auto it = m_archetypes.begin(); it != m_archetypes.end();) {
+            it->second->shrink();
+
+            if (it->second->entity_count() != 0) {
+                ++it;
+                continue;
+            }
+
+            it->second->parked = true;
+            m_parked_archetypes.insert(std::make_pair(it->first, std::move(it->second)));
+            it = m_archetypes.erase(it);
+        }
+
+        m_removal_mask.shrink_to_fit();
+        m_removal_ids.shrink_to_fit();
+    }
+
+    // totals of all archetypes, appends one entry per archetype to archetypes if given
+    WorldMemoryStats memory_stats(std::vector<ArchetypeMemoryStats> *archetypes = nullptr) {
+        WorldMemoryStats stats;
+
+        const auto add = [&](const Signature &signature, IArchetype &archetype) {
+            const ArchetypeMemoryStats entry{
+                .signature = signature.to_ullong(),
+                .rows = archetype.entity_count(),
+                .capacity = archetype.capacity(),
+                .row_bytes = archetype.row_size(),
+                .parked = archetype.parked,
+            };
+
+            stats.archetypes += 1;
+            stats.parked_archetypes += entry.parked;
+            stats.rows += entry.rows;
+            stats.bytes += entry.bytes();
+            stats.unused_bytes += entry.unused_bytes();
+
+            if (archetypes) {
+                archetypes->push_back(entry);
+            }
+        };
+
+        for (auto &[signature, archetype] : m_archetypes) {
+            add(signature, *archetype);
+        }
+        for (auto &[signature, archetype] : m_parked_archetypes) {
+            add(signature, *archetype);
+        }
+
+        return stats;
+    }
+
     template <class... Components> EntityId spawn(Components... components) {
         always_assert(m_queries_in_progress == 0, "cant spawn during active query");
         always_assert(m_next_entity_id != 0, "uh oh, we ran out of entity ids");
@@ -187,6 +467,9 @@ struct World {
         const auto signature = signature_of<Components...>();
 
         auto it = m_archetypes.find(signature);
+        if (it == m_archetypes.end()) {
+            it = unpark(signature);
+        }
 
         if (it == m_archetypes.end()) {
             it =
@@ -201,6 +484,77 @@ struct World {
         return entity_id;
     }
 
+    template <class... Components> ArchetypeHandle<Components...> archetype() {
+        const auto signature = signature_of<Components...>();
+
+        auto it = m_archetypes.find(signature);
+        if (it == m_archetypes.end()) {
+            it = unpark(signature);
+        }
+
+        if (it == m_archetypes.end()) {
+            it =
+                m_archetypes
+                    .insert(std::make_pair(signature, std::make_unique<Archetype<Components...>>()))
+                    .first;
+        }
+
+        auto archetype = dynamic_cast<Archetype<Components...> *>(it->second.get());
+        always_assert(archetype != nullptr,
+                      "archetype exists with a different component order");
+
+        return ArchetypeHandle<Components...>{.archetype = archetype};
+    }
+
+    template <class... Components>
+    EntityId spawn_in(ArchetypeHandle<Components...> handle, Components... components) {
+        always_assert(m_queries_in_progress == 0, "cant spawn during active query");
+        always_assert(m_next_entity_id != 0, "uh oh, we ran out of entity ids");
+
+        if (handle.archetype->parked) {
+            unpark(handle.archetype);
+        }
+
+        EntityId entity_id = m_next_entity_id++;
+        handle.archetype->add_entity(entity_id, components...);
+
+        return entity_id;
+    }
+
+    // spawns count entities with the components returned by generator(index, id) as a tuple.
+    // the archetype is resolved and grown once for the whole batch.
+    template <class... Components, class Generator>
+    EntityRange spawn_batch(usize count, Generator generator) {
+        return spawn_batch_in(archetype<Components...>(), count, generator);
+    }
+
+    template <class... Components, class Generator>
+    EntityRange spawn_batch_in(ArchetypeHandle<Components...> handle, usize count,
+                               Generator generator) {
+        always_assert(m_queries_in_progress == 0, "cant spawn during active query");
+        always_assert(m_next_entity_id + count > m_next_entity_id || count == 0,
+                      "uh oh, we ran out of entity ids");
+
+        if (handle.archetype->parked && count > 0) {
+            unpark(handle.archetype);
+        }
+
+        const EntityRange range{.first = m_next_entity_id, .count = count};
+        m_next_entity_id += count;
+
+        auto &archetype = *handle.archetype;
+        archetype.reserve(archetype.entity_count() + count);
+
+        for (usize i = 0; i < count; ++i) {
+            std::tuple<Components...> components = generator(i, range[i]);
+            std::apply(
+                [&](Components &...values) { archetype.add_entity(range[i], values...); },
+                components);
+        }
+
+        return range;
+    }
+
     template <class... Components> bool remove(EntityId id) {
         always_assert(m_queries_in_progress == 0, "cant remove during active query");
         const auto signature = signature_of<Components...>();
@@ -216,6 +570,82 @@ struct World {
         return false;
     }
 
+    // removes all given entities with one compacting pass per archetype instead of scanning
+    // every archetype once per id. returns how many entities were removed.
+    usize remove_many(std::span<const EntityId> ids) {
+        always_assert(m_queries_in_progress == 0, "cant remove during active query");
+        if (ids.empty())
+            return 0;
+
+        m_removal_ids.assign(ids.begin(), ids.end());
+        std::sort(m_removal_ids.begin(), m_removal_ids.end());
+
+        usize removed = 0;
+        for (auto &[archetype_signature, archetype] : m_archetypes) {
+            auto entity_ids = reinterpret_cast<EntityId *>(archetype->storage_of(typeid(EntityId)));
+            auto count = archetype->entity_count();
+
+            m_removal_mask.assign(count, 0);
+            bool any = false;
+            for (usize i = 0; i < count; ++i) {
+                if (std::binary_search(m_removal_ids.begin(), m_removal_ids.end(),
+                                       entity_ids[i])) {
+                    m_removal_mask[i] = 1;
+                    any = true;
+                }
+            }
+
+            if (any) {
+                removed += archetype->remove_rows(m_removal_mask.data());
+            }
+
+            if (removed == m_removal_ids.size())
+                break;
+        }
+
+        return removed;
+    }
+
+    // removes every entity with Components for which predicate(id, components...) returns true.
+    // the predicate runs exactly once per entity, so it may release resources of the entities it
+    // removes, but it must not spawn or remove entities itself.
+    template <class... Components, class Predicate> usize remove_if(Predicate predicate) {
+        always_assert(m_queries_in_progress == 0, "cant remove during active query");
+        const auto signature = signature_of<Components...>();
+
+        usize removed = 0;
+        for (auto &[archetype_signature, archetype] : m_archetypes) {
+            if (signature != (archetype_signature & signature))
+                continue; // signature does not fully overlap with this archetype
+
+            auto entity_ids = reinterpret_cast<EntityId *>(archetype->storage_of(typeid(EntityId)));
+
+            auto storages = std::tuple(reinterpret_cast<std::remove_reference_t<Components> *>(
+                archetype->storage_of(typeid(Components)))...);
+
+            auto count = archetype->entity_count();
+
+            m_removal_mask.assign(count, 0);
+            bool any = false;
+
+            m_queries_in_progress++;
+            for (usize i = 0; i < count; ++i) {
+                if (predicate(entity_ids[i],
+                              std::get<std::remove_reference_t<Components> *>(storages)[i]...)) {
+                    m_removal_mask[i] = 1;
+                    any = true;
+                }
+            }
+            m_queries_in_progress--;
+
+            if (any) {
+                removed += archetype->remove_rows(m_removal_mask.data());
+            }
+        }
+
+        return removed;
+    }
+
     template <class... Components> void delete_matching() {
         always_assert(m_queries_in_progress == 0, "cant clear entities during active query");
         const auto signature = signature_of<Components...>();
@@ -268,7 +698,35 @@ struct World {
         return std::nullopt;
     }
 
+    // points ref at the components of ref.id again, false if the entity is gone or lacks one
+    template <class... Components> bool refresh(EntityRef<Components...> &ref) {
+        const auto signature = signature_of<Components...>();
+
+        for (auto &[archetype_signature, archetype] : m_archetypes) {
+            if (signature != (archetype_signature & signature))
+                continue; // signature does not fully overlap with this archetype
+
+            auto entity_ids = reinterpret_cast<EntityId *>(archetype->storage_of(typeid(EntityId)));
+            auto count = archetype->entity_count();
+
+            for (usize i = 0; i < count; ++i) {
+                if (entity_ids[i] == ref.id) {
+                    ref.components = std::tuple<Components *...>(
+                        reinterpret_cast<Components *>(archetype->storage_of(typeid(Components))) +
+                        i...);
+                    ref.archetype = archetype.get();
+                    ref.version = archetype->version;
+                    return true;
+                }
+            }
+        }
+
+        ref.archetype = nullptr;
+        return false;
+    }
+
     template <class... Components, class Fn> void query(Fn fn) {
+        PROFILE_SCOPE("World::query");
         const auto signature = signature_of<Components...>();
 
         m_queries_in_progress++;
@@ -309,9 +767,25 @@ struct World {
 
     template <class... Components>
     std::vector<std::tuple<EntityId &, Components...>> query_into_vec() {
-        const auto signature = signature_of<Components...>();
-
         std::vector<std::tuple<EntityId &, Components...>> vec;
+        query_into_vec<Components...>(vec);
+        return vec;
+    }
+
+    // collects into arena memory, the vector is only valid until the arena is reset
+    template <class... Components>
+    ArenaVector<std::tuple<EntityId &, Components...>> query_into_vec(FrameArena &arena) {
+        ArenaVector<std::tuple<EntityId &, Components...>> vec{
+            ArenaAllocator<std::tuple<EntityId &, Components...>>(arena)};
+        vec.reserve(query_count<Components...>());
+        query_into_vec<Components...>(vec);
+        return vec;
+    }
+
+    // appends to vec, which allows callers to reuse its storage
+    template <class... Components, class Allocator>
+    void query_into_vec(std::vector<std::tuple<EntityId &, Components...>, Allocator> &vec) {
+        const auto signature = signature_of<Components...>();
 
         m_queries_in_progress++;
         for (auto &[archetype_signature, archetype] : m_archetypes) {
@@ -332,7 +806,29 @@ struct World {
             }
         }
         m_queries_in_progress--;
+    }
 
-        return vec;
+  private:
+    // moves a parked archetype back into query iteration, returns m_archetypes.end() if none
+    // with this signature is parked
+    std::unordered_map<Signature, std::unique_ptr<IArchetype>>::iterator
+    unpark(const Signature &signature) {
+        auto parked = m_parked_archetypes.find(signature);
+        if (parked == m_parked_archetypes.end())
+            return m_archetypes.end();
+
+        parked->second->parked = false;
+        auto it = m_archetypes.insert(std::make_pair(signature, std::move(parked->second))).first;
+        m_parked_archetypes.erase(parked);
+        return it;
+    }
+
+    void unpark(IArchetype *archetype) {
+        for (auto &[signature, parked] : m_parked_archetypes) {
+            if (parked.get() == archetype) {
+                unpark(Signature(signature));
+                return;
+            }
+        }
     }
 };
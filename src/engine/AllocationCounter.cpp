@@ -0,0 +1,44 @@
+#include "./AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef BUILD_RELEASE
+
+u64 thread_allocation_count() { return 0; }
+
+#else
+
+// plain integer, so accessing it never needs a thread local constructor that could allocate
+static thread_local u64 s_allocation_count = 0;
+
+u64 thread_allocation_count() { return s_allocation_count; }
+
+static void *counted_allocate(std::size_t size) {
+    ++s_allocation_count;
+
+    if (void *memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size) { return counted_allocate(size); }
+void *operator new[](std::size_t size) { return counted_allocate(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    ++s_allocation_count;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    ++s_allocation_count;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept { std::free(memory); }
+
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "defines.h"
+
+// heap allocations made through operator new by the calling thread. debug builds replace the
+// global operator new to count them, release builds (BUILD_RELEASE) always return 0.
+u64 thread_allocation_count();
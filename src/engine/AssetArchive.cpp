@@ -0,0 +1,134 @@
+#include "./AssetArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "engine/AssetArchiveFormat.h"
+
+AssetArchive::~AssetArchive() { close(); }
+
+bool AssetArchive::open(const std::string &path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const u8 *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    m_size = static_cast<usize>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = static_cast<const u8 *>(mapping);
+    m_size = static_cast<usize>(info.st_size);
+#endif
+
+    if (m_data == nullptr) {
+        close();
+        return false;
+    }
+
+    const auto *header = reinterpret_cast<const ArchiveHeader *>(m_data);
+    if (m_size < sizeof(ArchiveHeader) ||
+        std::memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+        header->version != ARCHIVE_VERSION ||
+        m_size < sizeof(ArchiveHeader) + header->entry_count * sizeof(ArchiveEntry)) {
+        std::cerr << "Invalid asset archive: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void AssetArchive::close() {
+#ifdef _WIN32
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file) {
+        CloseHandle(m_file);
+    }
+
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data) {
+        munmap(const_cast<u8 *>(m_data), m_size);
+    }
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+std::optional<std::span<const u8>> AssetArchive::find(std::string_view path) const {
+    if (!m_data) {
+        return std::nullopt;
+    }
+
+    const auto *header = reinterpret_cast<const ArchiveHeader *>(m_data);
+    const auto *entries = reinterpret_cast<const ArchiveEntry *>(m_data + sizeof(ArchiveHeader));
+    const auto *entries_end = entries + header->entry_count;
+
+    const auto hash = archive_path_hash(path);
+    const auto *entry = std::lower_bound(
+        entries, entries_end, hash,
+        [](const ArchiveEntry &entry, u64 hash) { return entry.path_hash < hash; });
+
+    if (entry == entries_end || entry->path_hash != hash) {
+        return std::nullopt;
+    }
+
+    if (entry->offset + entry->size > m_size) {
+        std::cerr << "Asset archive entry out of bounds: " << path << std::endl;
+        return std::nullopt;
+    }
+
+    return std::span<const u8>(m_data + entry->offset, entry->size);
+}
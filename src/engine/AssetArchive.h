@@ -0,0 +1,35 @@
+#pragma once
+
+#include "defines.h"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// read only view of a packed asset archive. the whole file is memory mapped once, lookups are a
+// binary search over the index and hand out pointers straight into the mapping.
+class AssetArchive {
+  public:
+    AssetArchive() = default;
+    ~AssetArchive();
+
+    AssetArchive(const AssetArchive &) = delete;
+    AssetArchive &operator=(const AssetArchive &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    bool is_open() const { return m_data != nullptr; }
+
+    std::optional<std::span<const u8>> find(std::string_view path) const;
+
+  private:
+    const u8 *m_data = nullptr;
+    usize m_size = 0;
+
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
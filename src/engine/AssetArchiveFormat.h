@@ -0,0 +1,44 @@
+#pragma once
+
+#include "defines.h"
+#include "engine/AssetHandle.h"
+
+#include <string_view>
+
+// layout of the packed asset archive, shared by navis-pack and AssetArchive:
+//   ArchiveHeader
+//   ArchiveEntry[entry_count], sorted by path_hash
+//   file data, every file aligned to ARCHIVE_ALIGNMENT
+const char ARCHIVE_MAGIC[4] = {'N', 'A', 'V', 'P'};
+const u32 ARCHIVE_VERSION = 1;
+const u64 ARCHIVE_ALIGNMENT = 16;
+const char *const ARCHIVE_FILE_NAME = "assets.pak";
+
+struct ArchiveHeader {
+    char magic[4];
+    u32 version;
+    u64 entry_count;
+};
+
+struct ArchiveEntry {
+    u64 path_hash;
+    u64 offset;
+    u64 size;
+};
+
+static_assert(sizeof(ArchiveHeader) == 16, "archive header must not contain padding");
+static_assert(sizeof(ArchiveEntry) == 24, "archive entry must not contain padding");
+
+// paths are stored relative to the directory the game used to be started from,
+// "./assets/a.bmp" and "assets/a.bmp" name the same file
+inline std::string_view normalize_archive_path(std::string_view path) {
+    while (path.starts_with("./")) {
+        path.remove_prefix(2);
+    }
+
+    return path;
+}
+
+inline u64 archive_path_hash(std::string_view path) {
+    return hash_path(normalize_archive_path(path));
+}
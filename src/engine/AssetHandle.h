@@ -0,0 +1,29 @@
+#pragma once
+
+#include "defines.h"
+
+#include <string_view>
+
+using AssetHandle = usize;
+
+enum struct AssetStatus : u8 {
+    Missing = 0,
+    // queued or being decoded on a worker
+    Loading = 1,
+    // decoded, waiting for its upload on the render thread
+    Decoded = 2,
+    Ready = 3,
+    Failed = 4,
+};
+
+// FNV-1a of the path, the same path always maps to the same handle no matter where the string
+// lives, also across processes
+inline AssetHandle hash_path(std::string_view path) {
+    u64 hash = 0xcbf29ce484222325;
+    for (auto c : path) {
+        hash ^= static_cast<u8>(c);
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
@@ -1,14 +1,74 @@
 #include "./AssetManager.h"
 
+#include <fstream>
+#include <iterator>
+
+#include <SDL3/SDL_filesystem.h>
+#include <SDL3/SDL_iostream.h>
 #include <SDL3_image/SDL_image.h>
 
 #include "EngineApi.h"
 #include "assert.h"
+#include "engine/AssetArchiveFormat.h"
+
+static std::string archive_path() {
+    const char *base_path = SDL_GetBasePath();
+    return std::string(base_path ? base_path : "") + ARCHIVE_FILE_NAME;
+}
+
+AssetManager::AssetManager(EngineApi &api)
+    : archive(),
+      textures(
+          api.workers,
+          [this](const std::string &path) -> std::optional<SDL_Surface *> {
+              SDL_Surface *surface = load_image(path);
+              if (surface == nullptr) {
+                  return std::nullopt;
+              }
+
+              return surface;
+          },
+          [&api](SDL_Surface *surface) {
+              SDL_Texture *texture = SDL_CreateTextureFromSurface(api.renderer, surface);
+              always_assert(texture != nullptr, "Texture upload failed: " << SDL_GetError());
+              SDL_DestroySurface(surface);
+              return texture;
+          }),
+      atlas(api.workers, [this](const std::string &path) { return load_image(path); }) {
+    if (!archive.open(archive_path())) {
+        std::cerr << "No asset archive next to the executable, loading assets from "
+                     "the working directory"
+                  << std::endl;
+    }
+}
+
+SDL_Surface *AssetManager::load_image(const std::string &path) const {
+    if (auto data = archive.find(path)) {
+        // decodes straight from the mapping, no copy
+        return IMG_Load_IO(SDL_IOFromConstMem(data->data(), data->size()), true);
+    }
+
+    return IMG_Load(path.c_str());
+}
+
+std::optional<std::string> AssetManager::read_file(const std::string &path) const {
+    if (auto data = archive.find(path)) {
+        return std::string(reinterpret_cast<const char *>(data->data()), data->size());
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+void AssetManager::upload_pending(SDL_Renderer *renderer) {
+    auto uploaded = textures.upload_pending(UPLOAD_BUDGET);
 
-AssetManager::AssetManager(const EngineApi &api)
-    : textures([&api](const char *path) {
-          SDL_Texture *texture = IMG_LoadTexture(api.renderer, path);
-          always_assert(texture != nullptr, "Texture load failed: " << path);
-          return texture;
-      }) {
+    // the atlas is a single upload, but only worth doing once it has everything decoded
+    if (uploaded < UPLOAD_BUDGET) {
+        atlas.update(renderer);
+    }
 }
@@ -1,42 +1,152 @@
 #pragma once
 
+#include "assert.h"
 #include "defines.h"
+#include "engine/AssetArchive.h"
+#include "engine/AssetHandle.h"
+#include "engine/TextureAtlas.h"
+#include "engine/WorkerPool.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <SDL3/SDL_render.h>
+#include <SDL3/SDL_timer.h>
 
 struct EngineApi;
 
-using AssetHandle = usize;
-
-template <class T> class AssetCache {
+// assets are keyed by the hash of their path. loading happens in two steps: decode_fn runs on a
+// worker thread, upload_fn on the render thread in upload_pending, so neither the simulation nor
+// a frame ever waits for the disk.
+template <class Decoded, class T> class AssetCache {
   public:
-    explicit AssetCache(std::function<T(const char *)> load_fn) : load_fn(load_fn) {}
+    using DecodeFn = std::function<std::optional<Decoded>(const std::string &path)>;
+    using UploadFn = std::function<T(Decoded)>;
+
+    AssetCache(WorkerPool &workers, DecodeFn decode_fn, UploadFn upload_fn)
+        : m_workers(workers), m_decode_fn(decode_fn), m_upload_fn(upload_fn) {}
+
     AssetHandle load(const char *path) {
-        const AssetHandle handle = std::hash<const char *>{}(path);
+        const AssetHandle handle = hash_path(path);
 
-        if (cached_assets.contains(handle)) {
-            return handle;
+        {
+            std::lock_guard lock(m_mutex);
+            auto [it, inserted] = m_entries.try_emplace(handle, Entry{.path = path});
+            if (!inserted) {
+                debug_assert(it->second.path == path, "asset path hash collision: " << path);
+                return handle;
+            }
         }
 
-        T asset = load_fn(path);
-        cached_assets[handle] = asset;
+        m_workers.submit([this, handle, path = std::string(path)]() {
+            auto decoded = m_decode_fn(path);
+
+            std::lock_guard lock(m_mutex);
+            auto &entry = m_entries.at(handle);
+            if (!decoded) {
+                std::cerr << "Asset load failed: " << path << std::endl;
+                entry.status = AssetStatus::Failed;
+                return;
+            }
+
+            entry.status = AssetStatus::Decoded;
+            m_decoded.emplace_back(handle, *decoded);
+        });
+
         return handle;
     }
 
-    T get(AssetHandle handle) const { return cached_assets.at(handle); }
+    // uploads at most budget decoded assets, returns how many were uploaded
+    usize upload_pending(usize budget) {
+        std::vector<std::pair<AssetHandle, Decoded>> to_upload;
+
+        {
+            std::lock_guard lock(m_mutex);
+            auto count = std::min<usize>(budget, m_decoded.size());
+            to_upload.assign(m_decoded.begin(), m_decoded.begin() + count);
+            m_decoded.erase(m_decoded.begin(), m_decoded.begin() + count);
+        }
+
+        for (auto &[handle, decoded] : to_upload) {
+            T asset = m_upload_fn(decoded);
+
+            std::lock_guard lock(m_mutex);
+            auto &entry = m_entries.at(handle);
+            entry.asset = asset;
+            entry.status = AssetStatus::Ready;
+        }
+
+        return to_upload.size();
+    }
+
+    AssetStatus status(AssetHandle handle) const {
+        std::lock_guard lock(m_mutex);
+        auto it = m_entries.find(handle);
+        return it == m_entries.end() ? AssetStatus::Missing : it->second.status;
+    }
+
+    T get(AssetHandle handle) const {
+        std::lock_guard lock(m_mutex);
+        const auto &entry = m_entries.at(handle);
+        debug_assert(entry.status == AssetStatus::Ready, "asset is not loaded: " << entry.path);
+        return entry.asset;
+    }
+
+    // blocks until the asset is uploaded, only for the render thread
+    T load_immediate(const char *path) {
+        auto handle = load(path);
+
+        while (true) {
+            auto current = status(handle);
+            if (current == AssetStatus::Ready || current == AssetStatus::Failed)
+                break;
+
+            if (upload_pending(SIZE_MAX) == 0) {
+                SDL_Delay(1);
+            }
+        }
 
-    T load_immediate(const char *path) { return get(load(path)); }
+        return get(handle);
+    }
 
   private:
-    const std::function<T(const char *)> load_fn;
-    std::unordered_map<AssetHandle, T> cached_assets;
+    struct Entry {
+        std::string path;
+        AssetStatus status = AssetStatus::Loading;
+        T asset{};
+    };
+
+    WorkerPool &m_workers;
+    const DecodeFn m_decode_fn;
+    const UploadFn m_upload_fn;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<AssetHandle, Entry> m_entries;
+    std::vector<std::pair<AssetHandle, Decoded>> m_decoded;
 };
 
 class AssetManager {
   public:
-    AssetManager(const EngineApi &api);
-    AssetCache<SDL_Texture *> textures;
+    // uploads per frame, keeps a burst of finished loads from stalling a single frame
+    static const usize UPLOAD_BUDGET = 4;
+
+    AssetManager(EngineApi &api);
+
+    // called once per frame on the render thread
+    void upload_pending(SDL_Renderer *renderer);
+
+    // look in the asset archive first and fall back to the file system, thread safe
+    SDL_Surface *load_image(const std::string &path) const;
+    std::optional<std::string> read_file(const std::string &path) const;
+
+    AssetArchive archive;
+    AssetCache<SDL_Surface *, SDL_Texture *> textures;
+    TextureAtlas atlas;
 };
@@ -3,40 +3,83 @@
 #include "SceneStack.h"
 #include "defines.h"
 #include "engine/AssetManager.h"
+#include "engine/FrameArena.h"
+#include "engine/WorkerPool.h"
 
 #include <SDL3/SDL_init.h>
 #include <SDL3/SDL_render.h>
 #include <SDL3/SDL_video.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+const u64 TICKS_PER_SECOND = 60;
+
 struct Time {
     f32 delta_time;
     f32 elapsed;
+
+    u64 tick;
+    // ticks skipped because the simulation could not keep up
+    u64 dropped_ticks;
+    // heap allocations made by the last tick, always 0 in release builds
+    u64 tick_allocations;
 };
 
 struct EngineApi {
-    EngineApi(i32 window_width, i32 window_height, const char *title)
-        : assets(*this), scenes(*this) {
-        SDL_Init(SDL_INIT_VIDEO);
-        SDL_CreateWindowAndRenderer(title, window_width, window_height, 0, &window, &renderer);
+    // headless apis have no window and no renderer, scenes can be updated but not rendered
+    EngineApi(i32 window_width, i32 window_height, const char *title, bool headless = false)
+        : window_width(window_width),
+          window_height(window_height),
+          workers(std::max(1u, std::thread::hardware_concurrency() / 2)),
+          assets(*this),
+          scenes(*this) {
+        if (headless) {
+            SDL_Init(0);
+        } else {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_CreateWindowAndRenderer(title, window_width, window_height, 0, &window, &renderer);
+            // presenting waits for the display, the render thread does not spin on one snapshot
+            vsync = SDL_SetRenderVSync(renderer, 1);
+        }
 
         time = {
-            .delta_time = 1.0f / 120.0f,
+            .delta_time = 1.0f / TICKS_PER_SECOND,
             .elapsed = 0.0f,
+            .tick = 0,
+            .dropped_ticks = 0,
+            .tick_allocations = 0,
         };
     }
 
+    // jobs reference the assets, so the workers have to stop before anything is destroyed
+    ~EngineApi() { workers.shutdown(); }
+
+    i32 window_width, window_height;
+
     SDL_Window *window = nullptr;
     SDL_Renderer *renderer = nullptr;
+    // false when the driver has no vsync, the game loop paces frames itself then
+    bool vsync = false;
+
+    WorkerPool workers;
 
     AssetManager assets;
     SceneStack scenes;
 
     std::function<void(const char *file_path, f32 x, f32 y)> on_file_dropped;
 
-    bool up = false;
-    bool down = false;
-    bool left = false;
-    bool right = false;
+    // written by the event loop, read by the simulation thread
+    std::atomic<bool> up = false;
+    std::atomic<bool> down = false;
+    std::atomic<bool> left = false;
+    std::atomic<bool> right = false;
+    // set by the rewind key, scenes with rollback take it back once they handled it
+    std::atomic<bool> rewind_requested = false;
 
     Time time;
+
+    // transient memory of the current tick, reset after every tick
+    FrameArena frame_arena;
 };
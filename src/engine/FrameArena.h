@@ -0,0 +1,97 @@
+#pragma once
+
+#include "assert.h"
+#include "defines.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// linear allocator for memory that only lives during one tick, only used on the simulation
+// thread. allocating bumps a pointer and reset() frees everything at once. when a tick needs more
+// than the block holds, overflow blocks are chained and merged into one bigger block on the next
+// reset, so after a few ticks the arena stops touching the heap.
+class FrameArena {
+  public:
+    explicit FrameArena(usize capacity = 256 * 1024)
+        : m_block(std::make_unique<std::byte[]>(capacity)), m_capacity(capacity) {}
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(usize size, usize alignment) {
+        auto offset = align_up(m_offset, alignment);
+        if (offset + size <= m_capacity) {
+            m_offset = offset + size;
+            m_used += size;
+            return m_block.get() + offset;
+        }
+
+        // overflow blocks are owned for the rest of the tick, they are never reused
+        m_overflow.push_back(std::make_unique<std::byte[]>(size + alignment));
+        m_overflow_size += size + alignment;
+        m_used += size;
+
+        auto address = reinterpret_cast<uintptr_t>(m_overflow.back().get());
+        return reinterpret_cast<void *>(align_up(address, alignment));
+    }
+
+    void reset() {
+        m_high_water = std::max(m_high_water, m_used);
+
+        if (!m_overflow.empty()) {
+            m_capacity = std::max(m_capacity * 2, m_capacity + m_overflow_size);
+            m_block = std::make_unique<std::byte[]>(m_capacity);
+            m_overflow.clear();
+            m_overflow_size = 0;
+        }
+
+        m_offset = 0;
+        m_used = 0;
+    }
+
+    usize used() const { return m_used; }
+    usize capacity() const { return m_capacity; }
+    // the most memory a single tick used so far
+    usize high_water() const { return std::max(m_high_water, m_used); }
+
+  private:
+    static usize align_up(usize value, usize alignment) {
+        debug_assert((alignment & (alignment - 1)) == 0, "alignment must be a power of two");
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    std::unique_ptr<std::byte[]> m_block;
+    usize m_capacity;
+    usize m_offset = 0;
+    usize m_used = 0;
+    usize m_high_water = 0;
+
+    std::vector<std::unique_ptr<std::byte[]>> m_overflow;
+    usize m_overflow_size = 0;
+};
+
+// std allocator handing out arena memory, deallocating does nothing. containers using it must
+// not outlive the tick they were created in.
+template <class T> struct ArenaAllocator {
+    using value_type = T;
+
+    FrameArena *arena;
+
+    ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+    template <class U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(usize count) {
+        return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, usize) {}
+
+    template <class U> bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+};
+
+template <class T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
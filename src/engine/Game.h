@@ -1,29 +1,77 @@
 #pragma once
 
+#include "AllocationCounter.h"
 #include "EngineApi.h"
+#include "Profiler.h"
+#include "RenderSnapshot.h"
 
 #include <SDL3/SDL_timer.h>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <atomic>
 #include <ctime>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct FileDrop {
+    std::string path;
+    f32 x, y;
+};
+
+// set while a headless game runs, SIGINT and SIGTERM ask it to close like the window would
+inline std::atomic<bool> *headless_should_close = nullptr;
 
 struct Game {
     i32 m_window_width, m_window_height;
 
-    bool m_should_close = false;
+    std::atomic<bool> m_should_close = false;
     EngineApi m_api;
 
+    // published by the simulation thread at the end of every tick, consumed by render
+    SnapshotBuffer m_snapshots;
+
+    // file drops arrive on the event loop but must be handled on the simulation thread
+    std::mutex m_drops_mutex;
+    std::vector<FileDrop> m_pending_drops;
+    std::vector<FileDrop> m_drops_to_handle;
+
+    // copies of the dropped tick count and the tick allocations for the render thread
+    std::atomic<u64> m_dropped_ticks_seen = 0;
+    std::atomic<u64> m_tick_allocations_seen = 0;
+
     u64 tick;
     u64 ns_per_tick;
     u64 start_time;
 
-    Game(i32 window_width, i32 window_height, const char *title)
+    // F3 toggles the frame time graph, F2 writes a chrome trace (profiler builds only)
+    bool m_show_profiler = false;
+
+    // no window and no render thread, the simulation runs on the calling thread until the process
+    // is stopped. meant for servers that only publish a state stream
+    bool m_headless = false;
+
+    // upper bound of ticks simulated per frame. if the simulation falls further behind, the
+    // backlog is dropped instead of making the next frame even slower
+    u64 max_ticks_per_frame = 5;
+
+    // frame rate limit of the render thread when the renderer has no vsync
+    u64 max_frames_per_second = 144;
+
+    Game(i32 window_width, i32 window_height, const char *title, bool headless = false)
         : m_window_width(),
           m_window_height(),
           m_should_close(false),
-          m_api(window_width, window_height, title) {}
+          m_api(window_width, window_height, title, headless),
+          m_headless(headless) {}
 
     void initialize() {
         tick = 0;
-        ns_per_tick = SDL_NS_PER_SECOND / 60;
+        ns_per_tick = SDL_NS_PER_SECOND / TICKS_PER_SECOND;
         start_time = SDL_GetTicksNS();
     }
 
@@ -36,10 +84,7 @@ struct Game {
             }
 
             if (event.type == SDL_EVENT_DROP_FILE) {
-                // TODO: event
-                if (m_api.on_file_dropped) {
-                    m_api.on_file_dropped(event.drop.data, event.drop.x, event.drop.y);
-                }
+                drop_file(event.drop.data, event.drop.x, event.drop.y);
             }
 
             if (event.type == SDL_EVENT_KEY_DOWN) {
@@ -56,6 +101,19 @@ struct Game {
                 case SDL_SCANCODE_W:
                     m_api.up = true;
                     break;
+                case SDL_SCANCODE_R:
+                    m_api.rewind_requested = true;
+                    break;
+#ifdef NAVIS_PROFILER
+                case SDL_SCANCODE_F2:
+                    if (Profiler::instance().export_chrome_trace("navis_trace.json")) {
+                        std::cout << "Wrote navis_trace.json" << std::endl;
+                    }
+                    break;
+                case SDL_SCANCODE_F3:
+                    m_show_profiler = !m_show_profiler;
+                    break;
+#endif
                 default:
                     break;
                 }
@@ -81,38 +139,208 @@ struct Game {
         }
     }
 
-    void update() { m_api.scenes.current()->update(m_api); }
+    // queues a file as if it was dropped on the window at x, y. safe to call from any thread
+    void drop_file(std::string path, f32 x, f32 y) {
+        std::lock_guard lock(m_drops_mutex);
+        m_pending_drops.push_back(FileDrop{.path = std::move(path), .x = x, .y = y});
+    }
+
+    void handle_file_drops() {
+        {
+            std::lock_guard lock(m_drops_mutex);
+            std::swap(m_pending_drops, m_drops_to_handle);
+        }
+
+        for (auto &drop : m_drops_to_handle) {
+            if (m_api.on_file_dropped) {
+                m_api.on_file_dropped(drop.path.c_str(), drop.x, drop.y);
+            }
+        }
+
+        m_drops_to_handle.clear();
+    }
+
+    void update() {
+        PROFILE_SCOPE("tick");
+        auto scene = m_api.scenes.current();
+        scene->update(m_api);
+
+        // nothing renders snapshots without a window
+        if (m_headless)
+            return;
+
+        PROFILE_SCOPE("snapshot");
+        auto &snapshot = m_snapshots.write_buffer();
+        snapshot.clear();
+        snapshot.tick = m_api.time.tick;
+        scene->snapshot(m_api, snapshot);
+        m_snapshots.publish();
+    }
 
     void render() {
+        PROFILE_SCOPE("render");
+        m_api.assets.upload_pending(m_api.renderer);
+
         SDL_SetRenderDrawColor(m_api.renderer, 0x00, 0x00, 0x00, 0x00);
         SDL_RenderClear(m_api.renderer);
 
-        m_api.scenes.current()->render(m_api);
+        const auto &snapshot = m_snapshots.acquire();
+
+        // the snapshot of tick n holds the states of tick n - 1 and n, it is shown while the
+        // simulation works on tick n + 1
+        auto now = SDL_GetTicksNS() - start_time;
+        auto since_tick = static_cast<f64>(now) - static_cast<f64>(snapshot.tick * ns_per_tick);
+        auto alpha = std::clamp(static_cast<f32>(since_tick / ns_per_tick), 0.0f, 1.0f);
+
+        m_api.scenes.current()->render(m_api, snapshot, alpha);
 
+#ifdef NAVIS_PROFILER
+        if (m_show_profiler) {
+            render_profiler(snapshot);
+        }
+#endif
+
+        PROFILE_SCOPE("SDL_RenderPresent");
         SDL_RenderPresent(m_api.renderer);
     }
 
-    void game_loop() {
-        initialize();
+#ifdef NAVIS_PROFILER
+    void render_profiler(const RenderSnapshot &snapshot) {
+        Profiler::instance().draw_graph(m_api.renderer, 8.0f, 24.0f, 240.0f, 64.0f);
+
+        char text[160];
+        std::snprintf(text, sizeof(text),
+                      "visible %llu  culled %llu  dropped ticks %llu  tick allocations %llu",
+                      static_cast<unsigned long long>(snapshot.visible_count),
+                      static_cast<unsigned long long>(snapshot.culled_count),
+                      static_cast<unsigned long long>(m_dropped_ticks_seen),
+                      static_cast<unsigned long long>(m_tick_allocations_seen));
+
+        SDL_SetRenderDrawColor(m_api.renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+        SDL_RenderDebugText(m_api.renderer, 8.0f, 8.0f, text);
+
+        f32 y = 96.0f;
+        std::string_view stats(snapshot.stats_text.data());
+        while (!stats.empty()) {
+            auto end = stats.find('\n');
+            auto line = stats.substr(0, end);
+
+            std::snprintf(text, sizeof(text), "%.*s", static_cast<i32>(line.size()), line.data());
+            SDL_RenderDebugText(m_api.renderer, 8.0f, y, text);
+            y += 10.0f;
+
+            if (end == std::string_view::npos)
+                break;
+            stats.remove_prefix(end + 1);
+        }
+    }
+#endif
+
+    void simulation_loop() {
+#ifdef NAVIS_PROFILER
+        Profiler::instance().set_thread_name("simulation");
+#endif
 
         while (!m_should_close) {
-            handle_events();
+            handle_file_drops();
 
             // fixed update
-            auto target_tick = (SDL_GetTicksNS() - start_time) / ns_per_tick;
+            auto now = SDL_GetTicksNS() - start_time;
+            auto target_tick = now / ns_per_tick;
+
+            if (target_tick - tick > max_ticks_per_frame) {
+                auto dropped = target_tick - tick - max_ticks_per_frame;
+                m_api.time.dropped_ticks += dropped;
+                tick += dropped;
+            }
+
             while (tick < target_tick) {
-                update();
+                [[maybe_unused]] auto tick_start = profiler_now_ns();
+
                 tick += 1;
+                m_api.time.tick = tick;
+
+                const auto allocations_before = thread_allocation_count();
+                update();
+                m_api.time.tick_allocations = thread_allocation_count() - allocations_before;
+
                 m_api.time.elapsed += m_api.time.delta_time;
+                m_api.frame_arena.reset();
+
+#ifdef NAVIS_PROFILER
+                Profiler::instance().end_tick(profiler_now_ns() - tick_start);
+#endif
+            }
+
+            m_dropped_ticks_seen = m_api.time.dropped_ticks;
+            m_tick_allocations_seen = m_api.time.tick_allocations;
+
+            auto next_tick = (tick + 1) * ns_per_tick;
+            now = SDL_GetTicksNS() - start_time;
+            if (next_tick > now) {
+                m_api.scenes.current()->idle(m_api, next_tick - now);
+
+                now = SDL_GetTicksNS() - start_time;
+                if (next_tick > now) {
+                    SDL_DelayNS(next_tick - now);
+                }
+            }
+        }
+    }
+
+    void game_loop() {
+        initialize();
+
+        if (m_headless) {
+            // without a window the process is only stopped by a signal, closing the loop
+            // instead lets the scene flush its files in on_exit
+            headless_should_close = &m_should_close;
+            std::signal(SIGINT, [](int) { *headless_should_close = true; });
+            std::signal(SIGTERM, [](int) { *headless_should_close = true; });
+
+            simulation_loop();
+            return;
+        }
+
+        std::thread simulation([this]() { simulation_loop(); });
+
+#ifdef NAVIS_PROFILER
+        Profiler::instance().set_thread_name("render");
+#endif
+
+        const u64 ns_per_frame = SDL_NS_PER_SECOND / max_frames_per_second;
+
+        while (!m_should_close) {
+            [[maybe_unused]] auto frame_start = profiler_now_ns();
+            const auto frame_deadline = SDL_GetTicksNS() + ns_per_frame;
+
+            {
+                PROFILE_SCOPE("handle_events");
+                handle_events();
             }
 
             render();
+
+#ifdef NAVIS_PROFILER
+            Profiler::instance().end_frame(profiler_now_ns() - frame_start);
+#endif
+
+            // with vsync SDL_RenderPresent already waited for the display
+            const auto now = SDL_GetTicksNS();
+            if (!m_api.vsync && frame_deadline > now) {
+                SDL_DelayNS(frame_deadline - now);
+            }
         }
+
+        simulation.join();
     }
 
     template <typename Scene, typename... Args> void run(Args... args) {
         m_api.scenes.push<Scene>(&args...);
 
         game_loop();
+
+        // destroys the scene, which finishes recordings and streams and removes the socket file
+        m_api.scenes.pop();
     }
 };
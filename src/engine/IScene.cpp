@@ -5,3 +5,5 @@ void IScene::on_exit(EngineApi &api) {}
 
 void IScene::on_resume(EngineApi &api) {}
 void IScene::on_pause(EngineApi &api) {}
+
+void IScene::idle(EngineApi &api, u64 available_ns) {}
@@ -1,13 +1,23 @@
 #pragma once
 
+#include "defines.h"
+
 class EngineApi;
+struct RenderSnapshot;
 
 class IScene {
   public:
     virtual ~IScene() {}
 
+    // update and snapshot are called from the simulation thread, render from the render thread.
+    // render must only read the snapshot, never the scene state.
     virtual void update(EngineApi &api) = 0;
-    virtual void render(EngineApi &api) = 0;
+    virtual void snapshot(EngineApi &api, RenderSnapshot &snapshot) = 0;
+    virtual void render(EngineApi &api, const RenderSnapshot &snapshot, float alpha) = 0;
+
+    // called on the simulation thread when a tick finished early, with the time left until the
+    // next tick. for deferrable work like garbage collection, must return well before that.
+    virtual void idle(EngineApi &api, u64 available_ns);
 
     virtual void on_enter(EngineApi &api);
     virtual void on_exit(EngineApi &api);
@@ -0,0 +1,243 @@
+#include "./LocalSocket.h"
+
+#include <iostream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+static const i32 SEND_FLAGS = MSG_NOSIGNAL;
+#else
+// macos has no MSG_NOSIGNAL, SO_NOSIGPIPE is set on the socket instead
+static const i32 SEND_FLAGS = 0;
+#endif
+
+static bool make_address(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return false;
+    }
+
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static void prepare_socket(i32 fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+#ifdef SO_NOSIGPIPE
+    i32 enabled = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+}
+#endif
+
+LocalSocketServer::~LocalSocketServer() { close(); }
+
+#ifdef _WIN32
+bool LocalSocketServer::listen(const std::string &path) {
+    std::cerr << "Local sockets are not supported on windows: " << path << std::endl;
+    return false;
+}
+
+void LocalSocketServer::close() {}
+
+usize LocalSocketServer::accept_clients(std::span<const u8>) { return 0; }
+
+void LocalSocketServer::broadcast(std::span<const u8>) {}
+
+bool LocalSocketServer::send_to(Client &, std::span<const u8>) { return false; }
+#else
+bool LocalSocketServer::listen(const std::string &path) {
+    close();
+
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        return false;
+    }
+
+    i32 fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    // a socket file left behind by a previous run would make bind fail
+    unlink(path.c_str());
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(fd, 16) != 0) {
+        std::cerr << "Cant listen on " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    prepare_socket(fd);
+    m_fd = fd;
+    m_path = path;
+    return true;
+}
+
+void LocalSocketServer::close() {
+    for (auto &client : m_clients) {
+        ::close(client.fd);
+    }
+    m_clients.clear();
+
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        unlink(m_path.c_str());
+    }
+
+    m_fd = -1;
+    m_path.clear();
+}
+
+usize LocalSocketServer::accept_clients(std::span<const u8> greeting) {
+    if (m_fd < 0) {
+        return 0;
+    }
+
+    usize accepted = 0;
+    while (true) {
+        i32 fd = accept(m_fd, nullptr, nullptr);
+        if (fd < 0) {
+            break;
+        }
+
+        prepare_socket(fd);
+        Client client{.fd = fd, .pending = {}};
+        if (!send_to(client, greeting)) {
+            ::close(fd);
+            continue;
+        }
+
+        m_clients.push_back(std::move(client));
+        ++accepted;
+    }
+
+    return accepted;
+}
+
+void LocalSocketServer::broadcast(std::span<const u8> data) {
+    std::erase_if(m_clients, [&](Client &client) {
+        if (send_to(client, data)) {
+            return false;
+        }
+
+        ::close(client.fd);
+        return true;
+    });
+}
+
+bool LocalSocketServer::send_to(Client &client, std::span<const u8> data) {
+    // queued bytes go first, the stream must arrive in order
+    if (!client.pending.empty()) {
+        client.pending.insert(client.pending.end(), data.begin(), data.end());
+        data = client.pending;
+    }
+
+    usize sent = 0;
+    while (sent < data.size()) {
+        auto result = send(client.fd, data.data() + sent, data.size() - sent, SEND_FLAGS);
+        if (result < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        sent += static_cast<usize>(result);
+    }
+
+    if (client.pending.empty()) {
+        client.pending.assign(data.begin() + sent, data.end());
+    } else {
+        client.pending.erase(client.pending.begin(), client.pending.begin() + sent);
+    }
+
+    return client.pending.size() <= MAX_PENDING;
+}
+#endif
+
+LocalSocketClient::~LocalSocketClient() { close(); }
+
+#ifdef _WIN32
+bool LocalSocketClient::connect(const std::string &path) {
+    std::cerr << "Local sockets are not supported on windows: " << path << std::endl;
+    return false;
+}
+
+void LocalSocketClient::close() {}
+
+bool LocalSocketClient::receive(std::vector<u8> &) { return false; }
+#else
+bool LocalSocketClient::connect(const std::string &path) {
+    close();
+
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        return false;
+    }
+
+    i32 fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        std::cerr << "Cant connect to " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    prepare_socket(fd);
+    m_fd = fd;
+    return true;
+}
+
+void LocalSocketClient::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+
+    m_fd = -1;
+}
+
+bool LocalSocketClient::receive(std::vector<u8> &out) {
+    if (m_fd < 0) {
+        return false;
+    }
+
+    u8 chunk[64 * 1024];
+    while (true) {
+        auto result = recv(m_fd, chunk, sizeof(chunk), 0);
+        if (result > 0) {
+            out.insert(out.end(), chunk, chunk + result);
+            continue;
+        }
+
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+
+        // 0 means the server closed the connection
+        close();
+        return false;
+    }
+}
+#endif
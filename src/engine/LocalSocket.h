@@ -0,0 +1,65 @@
+#pragma once
+
+#include "defines.h"
+
+#include <span>
+#include <string>
+#include <vector>
+
+// unix domain stream socket that many local processes can connect to. nothing ever blocks, data
+// a client can not take yet is queued for it and clients that fall too far behind are dropped.
+// not available on windows.
+class LocalSocketServer {
+  public:
+    LocalSocketServer() = default;
+    ~LocalSocketServer();
+
+    LocalSocketServer(const LocalSocketServer &) = delete;
+    LocalSocketServer &operator=(const LocalSocketServer &) = delete;
+
+    bool listen(const std::string &path);
+    void close();
+
+    bool is_open() const { return m_fd >= 0; }
+    usize client_count() const { return m_clients.size(); }
+
+    // accepts the waiting clients and sends greeting to each of them, returns how many connected
+    usize accept_clients(std::span<const u8> greeting);
+    void broadcast(std::span<const u8> data);
+
+  private:
+    // bytes queued for a single slow client before it gets disconnected
+    static const usize MAX_PENDING = 8 * 1024 * 1024;
+
+    struct Client {
+        i32 fd;
+        std::vector<u8> pending;
+    };
+
+    // false if the client has to be dropped
+    bool send_to(Client &client, std::span<const u8> data);
+
+    i32 m_fd = -1;
+    std::string m_path;
+    std::vector<Client> m_clients;
+};
+
+class LocalSocketClient {
+  public:
+    LocalSocketClient() = default;
+    ~LocalSocketClient();
+
+    LocalSocketClient(const LocalSocketClient &) = delete;
+    LocalSocketClient &operator=(const LocalSocketClient &) = delete;
+
+    bool connect(const std::string &path);
+    void close();
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // appends everything that arrived since the last call, returns false once the server is gone
+    bool receive(std::vector<u8> &out);
+
+  private:
+    i32 m_fd = -1;
+};
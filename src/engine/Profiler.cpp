@@ -0,0 +1,119 @@
+#include "./Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <SDL3/SDL_render.h>
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::ThreadEvents &Profiler::thread_events() {
+    // the buffers are owned by the profiler, so they outlive their threads for the export
+    thread_local ThreadEvents *events = nullptr;
+
+    if (!events) {
+        std::lock_guard lock(m_mutex);
+        m_threads.push_back(std::make_unique<ThreadEvents>());
+        events = m_threads.back().get();
+        events->id = m_threads.size();
+        events->name = "thread " + std::to_string(events->id);
+    }
+
+    return *events;
+}
+
+void Profiler::set_thread_name(const char *name) {
+    auto &events = thread_events();
+    std::lock_guard lock(events.mutex);
+    events.name = name;
+}
+
+void Profiler::record(const char *name, u64 start_ns, u64 end_ns) {
+    auto &events = thread_events();
+    std::lock_guard lock(events.mutex);
+    events.events.push(ProfileEvent{
+        .name = name,
+        .start_ns = start_ns,
+        .duration_ns = end_ns - start_ns,
+    });
+}
+
+void Profiler::end_frame(u64 frame_ns) {
+    std::lock_guard lock(m_mutex);
+    m_frame_ms.push(static_cast<f32>(frame_ns) / 1'000'000.0f);
+}
+
+void Profiler::end_tick(u64 tick_ns) {
+    std::lock_guard lock(m_mutex);
+    m_tick_ms.push(static_cast<f32>(tick_ns) / 1'000'000.0f);
+}
+
+bool Profiler::export_chrome_trace(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+
+    std::lock_guard lock(m_mutex);
+
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+
+    for (auto &thread : m_threads) {
+        std::lock_guard thread_lock(thread->mutex);
+
+        out << (first ? "" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)"
+            << thread->id << R"(,"args":{"name":")" << thread->name << "\"}}";
+        first = false;
+
+        for (usize i = 0; i < thread->events.size(); ++i) {
+            const auto &event = thread->events[i];
+
+            // chrome expects microseconds. scopes can start before the profiler exists
+            auto start = static_cast<i64>(event.start_ns - m_start_ns);
+            out << ",\n"
+                << R"({"name":")" << event.name << R"(","ph":"X","pid":1,"tid":)" << thread->id
+                << R"(,"ts":)" << static_cast<f64>(start) / 1000.0 << R"(,"dur":)"
+                << static_cast<f64>(event.duration_ns) / 1000.0 << "}";
+        }
+    }
+
+    out << "\n]}\n";
+    return out.good();
+}
+
+void Profiler::draw_graph(SDL_Renderer *renderer, f32 x, f32 y, f32 width, f32 height) {
+    const f32 BUDGET_MS = 1000.0f / 60.0f;
+
+    std::vector<SDL_FPoint> points;
+
+    const auto draw_history = [&](const RingBuffer<f32, FRAME_HISTORY> &history) {
+        points.clear();
+        for (usize i = 0; i < history.size(); ++i) {
+            // everything above twice the budget is clamped to the top of the graph
+            auto ratio = std::min(history[i] / (BUDGET_MS * 2.0f), 1.0f);
+            points.push_back(SDL_FPoint{
+                .x = x + width * static_cast<f32>(i) / FRAME_HISTORY,
+                .y = y + height - height * ratio,
+            });
+        }
+
+        if (points.size() > 1) {
+            SDL_RenderLines(renderer, points.data(), static_cast<int>(points.size()));
+        }
+    };
+
+    SDL_SetRenderDrawColor(renderer, 0x40, 0x40, 0x40, 0xFF);
+    SDL_RenderLine(renderer, x, y + height / 2.0f, x + width, y + height / 2.0f);
+
+    std::lock_guard lock(m_mutex);
+
+    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+    draw_history(m_frame_ms);
+
+    SDL_SetRenderDrawColor(renderer, 0x40, 0xFF, 0x40, 0xFF);
+    draw_history(m_tick_ms);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "defines.h"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct SDL_Renderer;
+
+// PROFILE_SCOPE("name") times the enclosing scope. it compiles to nothing unless the build
+// defines NAVIS_PROFILER (cmake option NAVIS_ENABLE_PROFILER), names must be string literals.
+#ifdef NAVIS_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+inline u64 profiler_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct ProfileEvent {
+    const char *name;
+    u64 start_ns;
+    u64 duration_ns;
+};
+
+// fixed size ring of the most recent values, old values get overwritten
+template <class T, usize Capacity> struct RingBuffer {
+    std::array<T, Capacity> m_items{};
+    usize m_next = 0;
+    usize m_count = 0;
+
+    void push(const T &item) {
+        m_items[m_next] = item;
+        m_next = (m_next + 1) % Capacity;
+        m_count = m_count < Capacity ? m_count + 1 : Capacity;
+    }
+
+    usize size() const { return m_count; }
+
+    // 0 is the oldest item still in the buffer
+    const T &operator[](usize index) const {
+        return m_items[(m_next + Capacity - m_count + index) % Capacity];
+    }
+};
+
+class Profiler {
+  public:
+    static const usize EVENTS_PER_THREAD = 1 << 16;
+    static const usize FRAME_HISTORY = 240;
+
+    static Profiler &instance();
+
+    void set_thread_name(const char *name);
+    void record(const char *name, u64 start_ns, u64 end_ns);
+
+    void end_frame(u64 frame_ns);
+    void end_tick(u64 tick_ns);
+
+    bool export_chrome_trace(const std::string &path);
+
+    // frame (white) and tick (green) times of the recent history, the middle line is the 60hz
+    // budget
+    void draw_graph(SDL_Renderer *renderer, f32 x, f32 y, f32 width, f32 height);
+
+  private:
+    struct ThreadEvents {
+        usize id;
+        std::string name;
+        std::mutex mutex;
+        RingBuffer<ProfileEvent, EVENTS_PER_THREAD> events;
+    };
+
+    ThreadEvents &thread_events();
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadEvents>> m_threads;
+
+    RingBuffer<f32, FRAME_HISTORY> m_frame_ms;
+    RingBuffer<f32, FRAME_HISTORY> m_tick_ms;
+
+    u64 m_start_ns = profiler_now_ns();
+};
+
+struct ScopedTimer {
+    const char *m_name;
+    u64 m_start_ns;
+
+    explicit ScopedTimer(const char *name) : m_name(name), m_start_ns(profiler_now_ns()) {}
+    ~ScopedTimer() { Profiler::instance().record(m_name, m_start_ns, profiler_now_ns()); }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "defines.h"
+#include "engine/AssetHandle.h"
+
+#include <array>
+#include <mutex>
+#include <vector>
+
+struct SpriteInstance {
+    AssetHandle texture;
+
+    // transform before and after the tick this snapshot was taken at
+    f32 previous_x, previous_y, previous_rotation;
+    f32 x, y, rotation;
+
+    // added on top of the interpolated rotation, e.g. radar dishes and gun barrels
+    f32 overlay_rotation;
+};
+
+enum struct RenderLayer : u8 {
+    Base = 0,
+    Overlay = 1,
+    Count,
+};
+
+// flat copy of everything the renderer needs from one tick. written by the simulation thread,
+// only read by the render thread after it has been published.
+struct RenderSnapshot {
+    std::array<std::vector<SpriteInstance>, static_cast<usize>(RenderLayer::Count)> layers;
+
+    f32 previous_camera_x, previous_camera_y;
+    f32 camera_x, camera_y;
+
+    u64 tick;
+
+    // sprite entities inside of the view and the ones skipped because they were outside of it
+    usize visible_count;
+    usize culled_count;
+
+    // scene specific numbers, shown below the profiler graph. lines are separated by \n
+    std::array<char, 1024> stats_text{};
+
+    std::vector<SpriteInstance> &layer(RenderLayer layer) {
+        return layers[static_cast<usize>(layer)];
+    }
+
+    const std::vector<SpriteInstance> &layer(RenderLayer layer) const {
+        return layers[static_cast<usize>(layer)];
+    }
+
+    // keeps the vector capacity, so steady state publishing does not allocate
+    void clear() {
+        for (auto &layer : layers) {
+            layer.clear();
+        }
+
+        visible_count = 0;
+        culled_count = 0;
+        stats_text[0] = '\0';
+    }
+};
+
+// triple buffer: the writer always owns one snapshot, the reader owns another and the third one
+// holds the latest published snapshot. neither side ever waits for the other to finish.
+class SnapshotBuffer {
+  public:
+    RenderSnapshot &write_buffer() { return m_snapshots[m_write]; }
+
+    void publish() {
+        std::lock_guard lock(m_mutex);
+        std::swap(m_write, m_ready);
+        m_has_new_snapshot = true;
+    }
+
+    // returns the newest published snapshot, stays valid until the next call
+    const RenderSnapshot &acquire() {
+        std::lock_guard lock(m_mutex);
+        if (m_has_new_snapshot) {
+            std::swap(m_read, m_ready);
+            m_has_new_snapshot = false;
+        }
+
+        return m_snapshots[m_read];
+    }
+
+  private:
+    std::array<RenderSnapshot, 3> m_snapshots{};
+    std::mutex m_mutex;
+
+    usize m_write = 0;
+    usize m_ready = 1;
+    usize m_read = 2;
+    bool m_has_new_snapshot = false;
+};
@@ -0,0 +1,71 @@
+#include "./SpriteBatch.h"
+
+#include <cmath>
+
+void SpriteBatch::draw(const AtlasRegion &region, f32 x, f32 y, f32 rotation) {
+    const f32 cos = std::cos(rotation);
+    const f32 sin = std::sin(rotation);
+
+    const f32 half_w = region.width / 2.0f;
+    const f32 half_h = region.height / 2.0f;
+
+    const SDL_FColor white{.r = 1.0f, .g = 1.0f, .b = 1.0f, .a = 1.0f};
+
+    const auto corner = [&](f32 local_x, f32 local_y, f32 u, f32 v) {
+        return SDL_Vertex{
+            .position = {.x = x + local_x * cos - local_y * sin,
+                         .y = y + local_x * sin + local_y * cos},
+            .color = white,
+            .tex_coord = {.x = u, .y = v},
+        };
+    };
+
+    const auto first = static_cast<i32>(m_vertices.size());
+
+    m_vertices.push_back(corner(-half_w, -half_h, region.u0, region.v0));
+    m_vertices.push_back(corner(half_w, -half_h, region.u1, region.v0));
+    m_vertices.push_back(corner(half_w, half_h, region.u1, region.v1));
+    m_vertices.push_back(corner(-half_w, half_h, region.u0, region.v1));
+
+    m_indices.insert(m_indices.end(),
+                     {first, first + 1, first + 2, first, first + 2, first + 3});
+}
+
+void SpriteBatch::flush(SDL_Renderer *renderer, SDL_Texture *texture) {
+    if (texture && !m_vertices.empty()) {
+        SDL_RenderGeometry(renderer, texture, m_vertices.data(),
+                           static_cast<int>(m_vertices.size()), m_indices.data(),
+                           static_cast<int>(m_indices.size()));
+    }
+
+    // keeps the capacity for the next frame
+    m_vertices.clear();
+    m_indices.clear();
+}
+
+void SpriteBatch::draw_snapshot(SDL_Renderer *renderer, const TextureAtlas &atlas,
+                                const RenderSnapshot &snapshot, f32 alpha) {
+    // chipmunk angles are continuous, rotations can be lerped without wrap around handling
+    const auto lerp = [alpha](f32 from, f32 to) { return from + (to - from) * alpha; };
+
+    const f32 view_x = lerp(snapshot.previous_camera_x, snapshot.camera_x);
+    const f32 view_y = lerp(snapshot.previous_camera_y, snapshot.camera_y);
+
+    for (const auto &layer : snapshot.layers) {
+        for (const auto &sprite : layer) {
+            auto region = atlas.find_region(sprite.texture);
+            if (!region)
+                continue;
+
+            auto rotation =
+                lerp(sprite.previous_rotation, sprite.rotation) + sprite.overlay_rotation;
+
+            auto x = lerp(sprite.previous_x, sprite.x) - view_x;
+            auto y = lerp(sprite.previous_y, sprite.y) - view_y;
+
+            draw(*region, x, y, rotation);
+        }
+
+        flush(renderer, atlas.texture());
+    }
+}
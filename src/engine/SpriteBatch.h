@@ -0,0 +1,29 @@
+#pragma once
+
+#include "defines.h"
+#include "engine/RenderSnapshot.h"
+#include "engine/TextureAtlas.h"
+
+#include <vector>
+
+#include <SDL3/SDL_render.h>
+
+// collects rotated quads on the cpu and submits them with one SDL_RenderGeometry call
+class SpriteBatch {
+  public:
+    // x and y are the center of the sprite, rotation is in radians
+    void draw(const AtlasRegion &region, f32 x, f32 y, f32 rotation);
+    // drops the batch without drawing while the texture is still loading
+    void flush(SDL_Renderer *renderer, SDL_Texture *texture);
+
+    // draws every layer of the snapshot, interpolated between its two ticks by alpha. each layer
+    // is one draw call
+    void draw_snapshot(SDL_Renderer *renderer, const TextureAtlas &atlas,
+                       const RenderSnapshot &snapshot, f32 alpha);
+
+    usize sprite_count() const { return m_vertices.size() / 4; }
+
+  private:
+    std::vector<SDL_Vertex> m_vertices;
+    std::vector<i32> m_indices;
+};
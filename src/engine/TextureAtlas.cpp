@@ -0,0 +1,170 @@
+#include "./TextureAtlas.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#include <SDL3/SDL_surface.h>
+
+#include "assert.h"
+
+TextureAtlas::~TextureAtlas() {
+    for (auto &image : m_images) {
+        if (image.surface) {
+            SDL_DestroySurface(image.surface);
+        }
+    }
+
+    if (m_texture) {
+        SDL_DestroyTexture(m_texture);
+    }
+}
+
+AssetHandle TextureAtlas::add(const char *path) {
+    AssetHandle handle;
+
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_handles.find(path);
+        if (it != m_handles.end()) {
+            return it->second;
+        }
+
+        handle = m_images.size();
+        m_handles.emplace(path, handle);
+        m_images.push_back(
+            Image{.path = path, .surface = nullptr, .status = AssetStatus::Loading});
+        ++m_loading;
+    }
+
+    m_workers.submit([this, handle, path = std::string(path)]() {
+        SDL_Surface *surface = m_decode_fn(path);
+        if (surface) {
+            // copy the alpha channel into the atlas instead of blending onto the empty atlas
+            SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+        } else {
+            std::cerr << "Texture load failed: " << path << std::endl;
+        }
+
+        std::lock_guard lock(m_mutex);
+        auto &image = m_images[handle];
+        image.surface = surface;
+        image.status = surface ? AssetStatus::Decoded : AssetStatus::Failed;
+        --m_loading;
+        m_dirty = true;
+    });
+
+    return handle;
+}
+
+AssetStatus TextureAtlas::status(AssetHandle handle) const {
+    std::lock_guard lock(m_mutex);
+    return handle < m_images.size() ? m_images[handle].status : AssetStatus::Missing;
+}
+
+bool TextureAtlas::update(SDL_Renderer *renderer) {
+    std::vector<SDL_Surface *> surfaces;
+
+    {
+        std::lock_guard lock(m_mutex);
+        // wait for everything in flight, rebuilding for every single image is wasted work
+        if (!m_dirty || m_loading != 0) {
+            return false;
+        }
+
+        m_dirty = false;
+        surfaces.reserve(m_images.size());
+        for (const auto &image : m_images) {
+            surfaces.push_back(image.surface);
+        }
+    }
+
+    build(renderer, surfaces);
+
+    std::lock_guard lock(m_mutex);
+    for (usize i = 0; i < surfaces.size(); ++i) {
+        if (m_images[i].status == AssetStatus::Decoded) {
+            m_images[i].status = AssetStatus::Ready;
+        }
+    }
+
+    return true;
+}
+
+void TextureAtlas::build(SDL_Renderer *renderer, const std::vector<SDL_Surface *> &surfaces) {
+    // failed images keep an empty region, so their handles stay valid
+    const auto width_of = [&](usize i) { return surfaces[i] ? surfaces[i]->w : 0; };
+    const auto height_of = [&](usize i) { return surfaces[i] ? surfaces[i]->h : 0; };
+
+    // shelf packing, tallest images first so every shelf wastes as little height as possible
+    std::vector<usize> order(surfaces.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](usize a, usize b) { return height_of(a) > height_of(b); });
+
+    std::vector<SDL_Rect> placements(surfaces.size());
+
+    i32 atlas_width = 256;
+    i32 atlas_height = 0;
+
+    while (true) {
+        i32 x = 0, y = 0, shelf_height = 0;
+        bool fits = true;
+
+        for (auto index : order) {
+            const auto w = width_of(index), h = height_of(index);
+            if (w + PADDING > atlas_width) {
+                fits = false;
+                break;
+            }
+
+            if (x + w + PADDING > atlas_width) {
+                x = 0;
+                y += shelf_height;
+                shelf_height = 0;
+            }
+
+            placements[index] = SDL_Rect{.x = x, .y = y, .w = w, .h = h};
+            x += w + PADDING;
+            shelf_height = std::max(shelf_height, h + PADDING);
+        }
+
+        atlas_height = y + shelf_height;
+        if (fits && atlas_height <= atlas_width) {
+            break;
+        }
+
+        atlas_width *= 2;
+    }
+
+    SDL_Surface *atlas =
+        SDL_CreateSurface(atlas_width, std::max(atlas_height, 1), SDL_PIXELFORMAT_RGBA32);
+    always_assert(atlas != nullptr, "Atlas surface creation failed: " << SDL_GetError());
+
+    m_regions.resize(surfaces.size());
+    for (usize i = 0; i < surfaces.size(); ++i) {
+        const auto &placement = placements[i];
+
+        if (surfaces[i]) {
+            SDL_BlitSurface(surfaces[i], nullptr, atlas, &placement);
+        }
+
+        m_regions[i] = AtlasRegion{
+            .u0 = static_cast<f32>(placement.x) / atlas->w,
+            .v0 = static_cast<f32>(placement.y) / atlas->h,
+            .u1 = static_cast<f32>(placement.x + placement.w) / atlas->w,
+            .v1 = static_cast<f32>(placement.y + placement.h) / atlas->h,
+            .width = static_cast<f32>(placement.w),
+            .height = static_cast<f32>(placement.h),
+        };
+    }
+
+    if (m_texture) {
+        SDL_DestroyTexture(m_texture);
+    }
+
+    m_texture = SDL_CreateTextureFromSurface(renderer, atlas);
+    always_assert(m_texture != nullptr, "Atlas upload failed: " << SDL_GetError());
+
+    SDL_DestroySurface(atlas);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "defines.h"
+#include "engine/AssetHandle.h"
+#include "engine/WorkerPool.h"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <SDL3/SDL_render.h>
+
+struct AtlasRegion {
+    // normalized texture coordinates inside the atlas
+    f32 u0, v0, u1, v1;
+    // size of the source image in pixels
+    f32 width, height;
+};
+
+// packs many small images into one texture, so everything drawn from it can be submitted with a
+// single draw call. images are decoded on the worker pool, the atlas is packed and uploaded by
+// update on the render thread once every added image is decoded.
+class TextureAtlas {
+  public:
+    using DecodeFn = std::function<SDL_Surface *(const std::string &path)>;
+
+    TextureAtlas(WorkerPool &workers, DecodeFn decode_fn)
+        : m_workers(workers), m_decode_fn(decode_fn) {}
+    ~TextureAtlas();
+
+    TextureAtlas(const TextureAtlas &) = delete;
+    TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+    // handles are indices into the atlas regions, they stay valid across rebuilds
+    AssetHandle add(const char *path);
+    AssetStatus status(AssetHandle handle) const;
+
+    // render thread only, returns true if the atlas was rebuilt
+    bool update(SDL_Renderer *renderer);
+
+    // render thread only, nullptr until the image made it into the uploaded atlas
+    const AtlasRegion *find_region(AssetHandle handle) const {
+        return handle < m_regions.size() ? &m_regions[handle] : nullptr;
+    }
+
+    SDL_Texture *texture() const { return m_texture; }
+
+  private:
+    static const i32 PADDING = 2;
+
+    struct Image {
+        std::string path;
+        SDL_Surface *surface;
+        AssetStatus status;
+    };
+
+    void build(SDL_Renderer *renderer, const std::vector<SDL_Surface *> &surfaces);
+
+    WorkerPool &m_workers;
+    const DecodeFn m_decode_fn;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, AssetHandle> m_handles;
+    std::vector<Image> m_images;
+    usize m_loading = 0;
+    bool m_dirty = false;
+
+    std::vector<AtlasRegion> m_regions;
+    SDL_Texture *m_texture = nullptr;
+};
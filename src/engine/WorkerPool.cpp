@@ -0,0 +1,59 @@
+#include "./WorkerPool.h"
+
+WorkerPool::WorkerPool(usize thread_count) {
+    m_threads.reserve(thread_count);
+    for (usize i = 0; i < thread_count; ++i) {
+        m_threads.emplace_back([this]() { run(); });
+    }
+}
+
+WorkerPool::~WorkerPool() { shutdown(); }
+
+void WorkerPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+
+        m_jobs.push_back(std::move(job));
+    }
+
+    m_condition.notify_one();
+}
+
+void WorkerPool::shutdown() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+        m_jobs.clear();
+    }
+
+    m_condition.notify_all();
+
+    for (auto &thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+void WorkerPool::run() {
+    while (true) {
+        std::function<void()> job;
+
+        {
+            std::unique_lock lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+
+            if (m_stopping) {
+                return;
+            }
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        job();
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "defines.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of threads working through a shared job queue, for work that must not block the
+// simulation or render thread
+class WorkerPool {
+  public:
+    explicit WorkerPool(usize thread_count);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void submit(std::function<void()> job);
+
+    // stops accepting jobs, drops the queued ones and waits for running jobs to finish
+    void shutdown();
+
+  private:
+    void run();
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::function<void()>> m_jobs;
+    bool m_stopping = false;
+};
@@ -1,12 +1,71 @@
-
 #include "defines.h"
 #include "engine/Game.h"
 
 #include "ShipSimulationScene.h"
+#include "StreamViewerScene.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+i32 main(i32 argc, char **argv) {
+    SimulationOptions options{};
+    std::string view_path;
+    std::vector<std::string> ship_paths;
+    bool headless = false;
+
+    for (i32 i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            options.record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            options.replay_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--gc-pause") == 0 && i + 1 < argc) {
+            options.gc.pause = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--gc-stepmul") == 0 && i + 1 < argc) {
+            options.gc.step_multiplier = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--no-lod") == 0) {
+            options.lod.enabled = false;
+        } else if (std::strcmp(argv[i], "--rollback") == 0 && i + 1 < argc) {
+            auto seconds = std::max(std::atoi(argv[++i]), 0);
+            options.rollback.capacity = static_cast<u32>(seconds * TICKS_PER_SECOND);
+        } else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            options.stream_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--view") == 0 && i + 1 < argc) {
+            view_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--ship") == 0 && i + 1 < argc) {
+            ship_paths.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--record <file>] [--replay <file>] [--gc-pause <percent>]"
+                         " [--gc-stepmul <percent>] [--no-lod] [--rollback <seconds>]"
+                         " [--stream <file|unix:path>]"
+                         " [--view <file|unix:path>] [--ship <script>]... [--headless]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    if (headless && !view_path.empty()) {
+        std::cerr << "--view needs a window, it cant be combined with --headless" << std::endl;
+        return 1;
+    }
+
+    Game game{1280, 720, "navis lua", headless};
+
+    if (!view_path.empty()) {
+        game.run<StreamViewerScene>(view_path);
+        return 0;
+    }
 
-i32 main() {
-    Game game{1280, 720, "navis lua"};
+    // nobody can drop files on a headless simulation, so ships can be given up front
+    for (usize i = 0; i < ship_paths.size(); ++i) {
+        game.drop_file(ship_paths[i], static_cast<f32>(i) * 300.0f, 360.0f);
+    }
 
-    game.run<ShipSimulationScene>();
+    game.run<ShipSimulationScene>(options);
     return 0;
 }
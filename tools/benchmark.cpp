@@ -0,0 +1,488 @@
+// runs scenario files headless through ShipSimulationScene and reports tick times.
+// usage: navis-bench [--baseline <file>] [--write-baseline <file>] [--threshold <percent>]
+//                    <scenarios...>
+// with a baseline, the exit code is 1 when the mean or p99 tick time of a scenario regressed by
+// more than the threshold (default 10%).
+
+#include "defines.h"
+#include "engine/AllocationCounter.h"
+#include "engine/EngineApi.h"
+#include "engine/Profiler.h"
+#include "engine/RenderSnapshot.h"
+
+#include "ShipSimulationScene.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <sol/sol.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct ScenarioShip {
+    std::string script;
+    f32 x, y;
+    // copies are placed dx/dy apart from each other
+    u32 count;
+    f32 dx, dy;
+};
+
+struct Scenario {
+    std::string name;
+    u64 ticks;
+    // seconds of rollback checkpoints, 0 runs without them
+    f64 rollback;
+    std::vector<ScenarioShip> ships;
+};
+
+// per tick averages in milliseconds, ecs is everything in the update that is not lua, physics or
+// the rollback checkpoint
+struct ScenarioResult {
+    std::string name;
+    u64 ticks;
+
+    f64 mean_ms, p99_ms;
+    f64 lua_ms, physics_ms, ecs_ms, snapshot_ms;
+
+    // only with rollback, the mean and slowest checkpoint and the memory of all of them
+    f64 checkpoint_ms, checkpoint_max_ms;
+    u64 checkpoint_bytes;
+
+    usize ships, peak_bodies, peak_projectiles;
+    usize peak_rss_bytes;
+
+    // heap allocations per tick and ticks that did not allocate, debug builds only
+    f64 allocations;
+    u64 allocation_free_ticks;
+
+    // lua collector work done in idle time per tick, the peak lua heap and the ticks in which
+    // the automatic collector ran inside the scripts
+    f64 gc_idle_ms;
+    u64 peak_lua_bytes;
+    u64 collections_in_update;
+};
+
+// the metrics stored in a baseline file, keyed by scenario name
+using Baseline = std::map<std::string, std::map<std::string, f64>>;
+
+static usize peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<usize>(usage.ru_maxrss);
+#else
+    return static_cast<usize>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// scenarios are lua files returning a table like
+// { name = "...", ticks = 5000, ships = { { script = "...", x = 0, y = 0, count = 2, dx = 64 } } }
+// and optionally rollback = <seconds> to save a checkpoint every tick
+static std::optional<Scenario> load_scenario(const std::string &path) {
+    sol::state lua;
+    lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::table);
+
+    auto result = lua.safe_script_file(path, sol::script_pass_on_error);
+    if (!result.valid()) {
+        sol::error error = result;
+        std::cerr << "cant load scenario " << path << ": " << error.what() << std::endl;
+        return std::nullopt;
+    }
+
+    sol::table table = result;
+    Scenario scenario{
+        .name = table.get_or<std::string>("name", path),
+        .ticks = table.get_or<u64>("ticks", 1000),
+        .rollback = table.get_or("rollback", 0.0),
+        .ships = {},
+    };
+
+    sol::optional<sol::table> ships = table["ships"];
+    if (!ships) {
+        std::cerr << "scenario " << path << " has no ships" << std::endl;
+        return std::nullopt;
+    }
+
+    for (const auto &[_, value] : *ships) {
+        sol::table ship = value;
+        scenario.ships.push_back(ScenarioShip{
+            .script = ship.get_or<std::string>("script", ""),
+            .x = ship.get_or("x", 0.0f),
+            .y = ship.get_or("y", 0.0f),
+            .count = ship.get_or<u32>("count", 1),
+            .dx = ship.get_or("dx", 0.0f),
+            .dy = ship.get_or("dy", 0.0f),
+        });
+    }
+
+    return scenario;
+}
+
+static ScenarioResult run_scenario(EngineApi &api, const Scenario &scenario) {
+    api.time.elapsed = 0.0f;
+    api.time.tick = 0;
+
+    SimulationOptions options{};
+    options.rollback.capacity = static_cast<u32>(scenario.rollback * TICKS_PER_SECOND);
+
+    api.scenes.push<ShipSimulationScene>(&options);
+    auto scene = std::static_pointer_cast<ShipSimulationScene>(api.scenes.current());
+
+    usize dropped = 0;
+    for (const auto &ship : scenario.ships) {
+        for (u32 i = 0; i < ship.count; ++i) {
+            api.on_file_dropped(ship.script.c_str(), ship.x + ship.dx * i, ship.y + ship.dy * i);
+            ++dropped;
+        }
+    }
+
+    // scripts load on the workers, every ship has to be in the world before the first tick
+    scene->m_ship_loader.wait();
+    scene->splice_loaded_ships(api);
+
+    if (scene->m_ships.size() != dropped) {
+        std::cerr << "[" << scenario.name << "] failed to spawn "
+                  << dropped - scene->m_ships.size() << " ships" << std::endl;
+    }
+
+    ScenarioResult result{.name = scenario.name, .ticks = scenario.ticks};
+    std::vector<u64> tick_ns;
+    tick_ns.reserve(scenario.ticks);
+
+    u64 lua_ns = 0, physics_ns = 0, ecs_ns = 0, snapshot_ns = 0;
+    u64 checkpoint_ns = 0, checkpoint_max_ns = 0;
+    u64 allocation_count = 0;
+    u64 gc_idle_ns = 0;
+    RenderSnapshot snapshot{};
+
+    for (u64 tick = 1; tick <= scenario.ticks; ++tick) {
+        api.time.tick = tick;
+        const auto allocations_before = thread_allocation_count();
+        scene->update(api);
+
+        const auto snapshot_start = profiler_now_ns();
+        snapshot.clear();
+        snapshot.tick = tick;
+        scene->snapshot(api, snapshot);
+        const auto snapshot_end = profiler_now_ns();
+
+        const auto allocations = thread_allocation_count() - allocations_before;
+        allocation_count += allocations;
+        result.allocation_free_ticks += allocations == 0 ? 1 : 0;
+
+        api.time.elapsed += api.time.delta_time;
+        api.frame_arena.reset();
+
+        const auto &timings = scene->m_timings;
+        const auto used_ns = timings.total_ns + (snapshot_end - snapshot_start);
+        lua_ns += timings.lua_ns;
+        physics_ns += timings.physics_ns;
+        checkpoint_ns += timings.checkpoint_ns;
+        checkpoint_max_ns = std::max(checkpoint_max_ns, timings.checkpoint_ns);
+        ecs_ns += timings.total_ns - timings.lua_ns - timings.physics_ns - timings.checkpoint_ns;
+        snapshot_ns += snapshot_end - snapshot_start;
+        tick_ns.push_back(used_ns);
+
+        // hand the rest of the tick budget to the scene like the game loop does
+        const u64 budget_ns = 1'000'000'000 / TICKS_PER_SECOND;
+        if (used_ns < budget_ns) {
+            scene->idle(api, budget_ns - used_ns);
+            gc_idle_ns += scene->m_gc_stats.idle_ns;
+        }
+
+        result.peak_lua_bytes = std::max(result.peak_lua_bytes, scene->m_gc_stats.memory_bytes);
+        result.peak_bodies = std::max(result.peak_bodies, scene->m_world.query_count<RigidBody>());
+        result.peak_projectiles =
+            std::max(result.peak_projectiles, scene->m_world.query_count<Projectile>());
+    }
+
+    result.ships = scene->m_world.query_count<ShipBrain>();
+    result.checkpoint_bytes = scene->m_rollback.stored_bytes();
+    result.collections_in_update = scene->m_gc_stats.collections_in_update;
+
+    api.on_file_dropped = nullptr;
+    api.scenes.pop();
+
+    const auto ticks = static_cast<f64>(std::max<u64>(scenario.ticks, 1));
+    const auto to_ms = [](u64 ns) { return static_cast<f64>(ns) / 1'000'000.0; };
+
+    u64 total_ns = 0;
+    for (auto ns : tick_ns) {
+        total_ns += ns;
+    }
+
+    result.mean_ms = to_ms(total_ns) / ticks;
+    result.lua_ms = to_ms(lua_ns) / ticks;
+    result.physics_ms = to_ms(physics_ns) / ticks;
+    result.ecs_ms = to_ms(ecs_ns) / ticks;
+    result.snapshot_ms = to_ms(snapshot_ns) / ticks;
+    result.checkpoint_ms = to_ms(checkpoint_ns) / ticks;
+    result.checkpoint_max_ms = to_ms(checkpoint_max_ns);
+    result.allocations = static_cast<f64>(allocation_count) / ticks;
+    result.gc_idle_ms = to_ms(gc_idle_ns) / ticks;
+
+    if (!tick_ns.empty()) {
+        auto p99_index = (tick_ns.size() * 99 + 99) / 100 - 1;
+        std::nth_element(tick_ns.begin(), tick_ns.begin() + p99_index, tick_ns.end());
+        result.p99_ms = to_ms(tick_ns[p99_index]);
+    }
+
+    // rss is only ever growing, scenarios should be run in separate processes to compare it
+    result.peak_rss_bytes = peak_rss_bytes();
+    return result;
+}
+
+// just enough json for baseline files: nested objects with number values
+struct JsonReader {
+    const std::string &m_text;
+    usize m_cursor = 0;
+
+    void skip_whitespace() {
+        while (m_cursor < m_text.size() && std::isspace(static_cast<u8>(m_text[m_cursor]))) {
+            ++m_cursor;
+        }
+    }
+
+    bool consume(char c) {
+        skip_whitespace();
+        if (m_cursor < m_text.size() && m_text[m_cursor] == c) {
+            ++m_cursor;
+            return true;
+        }
+
+        return false;
+    }
+
+    std::optional<std::string> read_string() {
+        if (!consume('"'))
+            return std::nullopt;
+
+        auto end = m_text.find('"', m_cursor);
+        if (end == std::string::npos)
+            return std::nullopt;
+
+        auto value = m_text.substr(m_cursor, end - m_cursor);
+        m_cursor = end + 1;
+        return value;
+    }
+
+    std::optional<f64> read_number() {
+        skip_whitespace();
+        const char *start = m_text.c_str() + m_cursor;
+        char *end = nullptr;
+        auto value = std::strtod(start, &end);
+        if (end == start)
+            return std::nullopt;
+
+        m_cursor += end - start;
+        return value;
+    }
+
+    template <class Fn> bool read_object(Fn on_member) {
+        if (!consume('{'))
+            return false;
+
+        if (consume('}'))
+            return true;
+
+        do {
+            auto key = read_string();
+            if (!key || !consume(':') || !on_member(*key))
+                return false;
+        } while (consume(','));
+
+        return consume('}');
+    }
+};
+
+static std::optional<Baseline> read_baseline(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "cant read baseline " << path << std::endl;
+        return std::nullopt;
+    }
+
+    const std::string text(std::istreambuf_iterator<char>(file), {});
+    JsonReader reader{.m_text = text};
+
+    Baseline baseline;
+    auto valid = reader.read_object([&](const std::string &scenario) {
+        return reader.read_object([&](const std::string &metric) {
+            auto value = reader.read_number();
+            if (value) {
+                baseline[scenario][metric] = *value;
+            }
+            return value.has_value();
+        });
+    });
+
+    if (!valid) {
+        std::cerr << "invalid baseline " << path << std::endl;
+        return std::nullopt;
+    }
+
+    return baseline;
+}
+
+static std::map<std::string, f64> metrics_of(const ScenarioResult &result) {
+    return {
+        {"mean_ms", result.mean_ms},       {"p99_ms", result.p99_ms},
+        {"lua_ms", result.lua_ms},         {"physics_ms", result.physics_ms},
+        {"ecs_ms", result.ecs_ms},         {"snapshot_ms", result.snapshot_ms},
+        {"gc_idle_ms", result.gc_idle_ms}, {"checkpoint_ms", result.checkpoint_ms},
+        {"peak_rss_mb", static_cast<f64>(result.peak_rss_bytes) / (1024.0 * 1024.0)},
+    };
+}
+
+static bool write_baseline(const std::string &path, const std::vector<ScenarioResult> &results) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "cant write baseline " << path << std::endl;
+        return false;
+    }
+
+    file << "{\n";
+    for (usize i = 0; i < results.size(); ++i) {
+        file << "    \"" << results[i].name << "\": {\n";
+
+        auto metrics = metrics_of(results[i]);
+        usize j = 0;
+        for (const auto &[metric, value] : metrics) {
+            file << "        \"" << metric << "\": " << value
+                 << (++j < metrics.size() ? ",\n" : "\n");
+        }
+
+        file << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "}\n";
+
+    return true;
+}
+
+static void print_result(const ScenarioResult &result) {
+    std::printf("%s: %llu ticks, %zu ships, peak %zu bodies / %zu projectiles\n",
+                result.name.c_str(), static_cast<unsigned long long>(result.ticks), result.ships,
+                result.peak_bodies, result.peak_projectiles);
+    std::printf("    tick mean %.3f ms  p99 %.3f ms\n", result.mean_ms, result.p99_ms);
+    std::printf("    lua %.3f ms  physics %.3f ms  ecs %.3f ms  snapshot %.3f ms\n",
+                result.lua_ms, result.physics_ms, result.ecs_ms, result.snapshot_ms);
+    if (result.checkpoint_bytes > 0) {
+        std::printf("    checkpoint %.3f ms  max %.3f ms  stored %.1f MiB\n", result.checkpoint_ms,
+                    result.checkpoint_max_ms,
+                    static_cast<f64>(result.checkpoint_bytes) / (1024.0 * 1024.0));
+    }
+    std::printf("    peak rss %.1f MiB  allocations %.1f per tick, %llu ticks without any\n",
+                static_cast<f64>(result.peak_rss_bytes) / (1024.0 * 1024.0), result.allocations,
+                static_cast<unsigned long long>(result.allocation_free_ticks));
+    std::printf("    lua gc %.3f ms idle per tick, peak heap %.1f MiB, "
+                "%llu collections inside scripts\n",
+                result.gc_idle_ms, static_cast<f64>(result.peak_lua_bytes) / (1024.0 * 1024.0),
+                static_cast<unsigned long long>(result.collections_in_update));
+}
+
+// only the tick times are compared, the split and the memory are there to explain a regression
+static bool compare_to_baseline(const Baseline &baseline, const ScenarioResult &result,
+                                f64 threshold) {
+    auto it = baseline.find(result.name);
+    if (it == baseline.end()) {
+        std::printf("    no baseline\n");
+        return true;
+    }
+
+    bool passed = true;
+    auto metrics = metrics_of(result);
+
+    for (const char *metric : {"mean_ms", "p99_ms"}) {
+        auto expected = it->second.find(metric);
+        if (expected == it->second.end() || expected->second <= 0.0)
+            continue;
+
+        auto change = metrics[metric] / expected->second - 1.0;
+        auto regressed = change > threshold;
+        passed = passed && !regressed;
+
+        std::printf("    %s %.3f ms vs baseline %.3f ms (%+.1f%%)%s\n", metric, metrics[metric],
+                    expected->second, change * 100.0, regressed ? "  REGRESSION" : "");
+    }
+
+    return passed;
+}
+
+i32 main(i32 argc, char **argv) {
+    std::string baseline_path, write_baseline_path;
+    f64 threshold = 0.10;
+    std::vector<std::string> scenario_paths;
+
+    for (i32 i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--write-baseline") == 0 && i + 1 < argc) {
+            write_baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = std::atof(argv[++i]) / 100.0;
+        } else {
+            scenario_paths.push_back(argv[i]);
+        }
+    }
+
+    if (scenario_paths.empty()) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--baseline <file>] [--write-baseline <file>] [--threshold <percent>]"
+                     " <scenarios...>"
+                  << std::endl;
+        return 1;
+    }
+
+    std::optional<Baseline> baseline;
+    if (!baseline_path.empty()) {
+        baseline = read_baseline(baseline_path);
+        if (!baseline)
+            return 1;
+    }
+
+    EngineApi api{1280, 720, "navis bench", true};
+
+    std::vector<ScenarioResult> results;
+    bool passed = true;
+
+    for (const auto &path : scenario_paths) {
+        auto scenario = load_scenario(path);
+        if (!scenario)
+            return 1;
+
+        results.push_back(run_scenario(api, *scenario));
+        print_result(results.back());
+
+        if (baseline) {
+            passed = compare_to_baseline(*baseline, results.back(), threshold) && passed;
+        }
+    }
+
+    if (!write_baseline_path.empty() && !write_baseline(write_baseline_path, results))
+        return 1;
+
+    return passed ? 0 : 1;
+}
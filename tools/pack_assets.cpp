@@ -0,0 +1,100 @@
+// packs asset files into one archive that AssetArchive can memory map.
+// usage: navis-pack <output> <root directory> <files...>
+// files are stored under their path relative to the root directory.
+
+#include "defines.h"
+#include "engine/AssetArchiveFormat.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+struct PackedFile {
+    std::string path;
+    std::vector<char> data;
+    ArchiveEntry entry;
+};
+
+i32 main(i32 argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <output> <root directory> <files...>" << std::endl;
+        return 1;
+    }
+
+    const std::filesystem::path output = argv[1];
+    const std::filesystem::path root = argv[2];
+
+    std::vector<PackedFile> files;
+
+    for (i32 i = 3; i < argc; ++i) {
+        const std::filesystem::path file_path = argv[i];
+        auto path = std::filesystem::relative(file_path, root).generic_string();
+
+        std::ifstream input(file_path, std::ios::binary);
+        if (!input) {
+            std::cerr << "cant read " << file_path << std::endl;
+            return 1;
+        }
+
+        PackedFile file{
+            .path = path,
+            .data = std::vector<char>(std::istreambuf_iterator<char>(input), {}),
+            .entry = {.path_hash = archive_path_hash(path), .offset = 0, .size = 0},
+        };
+        file.entry.size = file.data.size();
+        files.push_back(std::move(file));
+    }
+
+    std::sort(files.begin(), files.end(), [](const PackedFile &a, const PackedFile &b) {
+        return a.entry.path_hash < b.entry.path_hash;
+    });
+
+    for (usize i = 1; i < files.size(); ++i) {
+        if (files[i].entry.path_hash == files[i - 1].entry.path_hash) {
+            std::cerr << "path hash collision: " << files[i - 1].path << " and " << files[i].path
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    const auto align = [](u64 offset) {
+        return (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+    };
+
+    u64 offset = align(sizeof(ArchiveHeader) + files.size() * sizeof(ArchiveEntry));
+    for (auto &file : files) {
+        file.entry.offset = offset;
+        offset = align(offset + file.entry.size);
+    }
+
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "cant write " << output << std::endl;
+        return 1;
+    }
+
+    ArchiveHeader header{.magic = {}, .version = ARCHIVE_VERSION, .entry_count = files.size()};
+    std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (const auto &file : files) {
+        out.write(reinterpret_cast<const char *>(&file.entry), sizeof(file.entry));
+    }
+
+    for (const auto &file : files) {
+        const auto padding = file.entry.offset - static_cast<u64>(out.tellp());
+        for (u64 i = 0; i < padding; ++i) {
+            out.put(0);
+        }
+
+        out.write(file.data.data(), static_cast<std::streamsize>(file.data.size()));
+    }
+
+    std::cout << "packed " << files.size() << " files into " << output << std::endl;
+    return 0;
+}